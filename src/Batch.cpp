@@ -0,0 +1,125 @@
+#include "Batch.hpp"
+#include "Jobs.hpp"
+#include "Platform.hpp"
+
+
+// A tick takes a few microseconds, so a job steps several games
+constexpr u32 GAMES_PER_JOB = 16;
+
+struct BatchStepJob {
+    GameBatch *batch;
+    u8 *actions;
+};
+
+
+static void
+StartGame(GameBatch *batch, u32 i) {
+    GameState *game = &batch->games[i];
+    GameInit(game, batch->window_width, batch->window_height);
+    game->world.is_single_threaded = true;
+    batch->ticks[i] = 0;
+}
+
+static void
+SetObservationCell(u8 *observation, Vector2Int cell, u8 value) {
+    if (cell.x >= 0 && cell.x < MAZE_WIDTH && cell.y >= 0 && cell.y < MAZE_HEIGHT) {
+        observation[cell.y * MAZE_WIDTH + cell.x] = value;
+    }
+}
+
+static void
+WriteObservation(GameState *game, u8 *observation) {
+    for (s32 y = 0; y < MAZE_HEIGHT; ++y) {
+        for (s32 x = 0; x < MAZE_WIDTH; ++x) {
+            observation[y * MAZE_WIDTH + x] = game->maze.cells[y][x];
+        }
+    }
+
+    // Eaten ghosts cannot hurt Pacman, and the ghosts lose their
+    // Transform when he dies
+    World *world = &game->world;
+    for (u32 i = 0; i < GHOST_COUNT; ++i) {
+        Ghost *ghost = &game->ghost_ai_system.ghosts[i];
+        if (ghost->state != STATE_EATEN && (GetMask(world, ghost->id) & MASK_TRANSFORM)) {
+            Vector2Int cell = ToCellCoordinates(GetTransform(world, ghost->id).translate, world->cell_size);
+            u8 value = (ghost->state == STATE_FRIGHTENED) ? OBSERVATION_FRIGHTENED_GHOST : OBSERVATION_GHOST;
+            SetObservationCell(observation, cell, value);
+        }
+    }
+
+    Entity pacman = game->player_input_system.pacman;
+    Vector2Int pacman_cell = ToCellCoordinates(GetTransform(world, pacman).translate, world->cell_size);
+    SetObservationCell(observation, pacman_cell, OBSERVATION_PACMAN);
+}
+
+static void
+StepGames(void *data, u32 begin, u32 end) {
+    // Indexed by DIRECTION
+    static const s32 ACTION_KEYS[] = { KEY_W, KEY_A, KEY_S, KEY_D, KEY_NONE };
+
+    BatchStepJob *job = static_cast<BatchStepJob *>(data);
+    GameBatch *batch = job->batch;
+    for (u32 i = begin; i < end; ++i) {
+        GameState *game = &batch->games[i];
+        if (batch->dones[i]) {
+            ResetGame(game);
+            batch->ticks[i] = 0;
+        }
+
+        u8 action = job->actions[i];
+        ASSERT(action <= DIRECTION_NONE);
+        Input input = {};
+        input.last_pressed_key = ACTION_KEYS[action];
+        input.is_key_down[ACTION_KEYS[action]] = (action != DIRECTION_NONE);
+
+        u32 score = game->player_input_system.score;
+        GameUpdate(game, BATCH_TICK_SECONDS, input);
+        batch->ticks[i] += 1;
+
+        batch->rewards[i] = static_cast<f32>(game->player_input_system.score - score);
+        batch->dones[i] = game->player_input_system.is_dead || game->maze.num_dots == 0 ||
+                          (batch->max_ticks > 0 && batch->ticks[i] >= batch->max_ticks);
+        WriteObservation(game, &batch->observations[i * BATCH_OBSERVATION_SIZE]);
+    }
+}
+
+void
+InitGameBatch(GameBatch *batch, u32 num_games, s32 window_width, s32 window_height, u32 max_ticks) {
+    batch->num_games = num_games;
+    batch->window_width = window_width;
+    batch->window_height = window_height;
+    batch->max_ticks = max_ticks;
+    batch->games = static_cast<GameState *>(PlatformAllocateMemory(num_games * sizeof(GameState)));
+    batch->ticks = static_cast<u32 *>(PlatformAllocateMemory(num_games * sizeof(u32)));
+    batch->observations = static_cast<u8 *>(PlatformAllocateMemory(num_games * BATCH_OBSERVATION_SIZE));
+    batch->rewards = static_cast<f32 *>(PlatformAllocateMemory(num_games * sizeof(f32)));
+    batch->dones = static_cast<bool *>(PlatformAllocateMemory(num_games * sizeof(bool)));
+    for (u32 i = 0; i < num_games; ++i) {
+        StartGame(batch, i);
+        batch->rewards[i] = 0.0f;
+        batch->dones[i] = false;
+        WriteObservation(&batch->games[i], &batch->observations[i * BATCH_OBSERVATION_SIZE]);
+    }
+}
+
+void
+BatchStep(GameBatch *batch, u8 *actions) {
+    BatchStepJob job;
+    job.batch = batch;
+    job.actions = actions;
+    ParallelFor(batch->num_games, GAMES_PER_JOB, StepGames, &job);
+}
+
+void
+FreeGameBatch(GameBatch *batch) {
+    for (u32 i = 0; i < batch->num_games; ++i) {
+        FreeGame(&batch->games[i]);
+    }
+
+    PlatformFreeMemory(batch->games);
+    PlatformFreeMemory(batch->ticks);
+    PlatformFreeMemory(batch->observations);
+    PlatformFreeMemory(batch->rewards);
+    PlatformFreeMemory(batch->dones);
+    *batch = {};
+}
@@ -0,0 +1,52 @@
+#ifndef PACMAN_BATCH_HPP
+#define PACMAN_BATCH_HPP
+#include "Common.hpp"
+#include "Game.hpp"
+#include "Maze.hpp"
+#include "Systems.hpp"
+
+
+// What a cell of an observation holds. Cells without an entity have the
+// type of the Maze cell, d, D, E or W. Pacman is written over the ghosts.
+enum {
+    OBSERVATION_PACMAN = W + 1,
+    OBSERVATION_GHOST,
+    OBSERVATION_FRIGHTENED_GHOST,
+};
+
+constexpr u32 BATCH_OBSERVATION_SIZE = MAZE_HEIGHT * MAZE_WIDTH;
+constexpr f32 BATCH_TICK_SECONDS = 1.0f / 60.0f;
+
+// Steps many independent games in lockstep, e.g., to train agents. Every
+// array has an entry for every game, and observations has
+// BATCH_OBSERVATION_SIZE of them, one per cell, row by row. The arrays
+// are allocated once and rewritten by every step.
+struct GameBatch {
+    GameState *games;
+    u32 num_games;
+    s32 window_width; // Every game is simulated at this size, it scales the speeds
+    s32 window_height;
+    u32 max_ticks; // Longer games are done, 0 for no limit
+
+    u32 *ticks; // Since the game was started
+    u8 *observations;
+    f32 *rewards; // Points scored in the last step
+    bool *dones; // Pacman died, ate every dot, or ran out of ticks
+};
+
+
+void
+InitGameBatch(GameBatch *batch, u32 num_games, s32 window_width, s32 window_height, u32 max_ticks);
+
+// Runs one tick of every game with actions[i], one of the DIRECTIONs, as
+// the input of game i. DIRECTION_NONE keeps the last direction. The games
+// are split between all threads of the job system, and each one runs its
+// systems on the thread it is given to. A game that was done after the
+// last step is started over first, with ResetGame.
+void
+BatchStep(GameBatch *batch, u8 *actions);
+
+void
+FreeGameBatch(GameBatch *batch);
+
+#endif // PACMAN_BATCH_HPP
@@ -0,0 +1,116 @@
+#include "Commands.hpp"
+#include "Platform.hpp"
+
+
+static Command *
+PushCommand(CommandBuffer *buffer, u32 type, Entity entity) {
+    if (buffer->num_commands == buffer->capacity) {
+        u32 new_capacity = (buffer->capacity > 0) ? buffer->capacity * 2 : 64;
+        Command *new_commands = static_cast<Command *>(PlatformAllocateMemory(new_capacity * sizeof(Command)));
+        for (u32 i = 0; i < buffer->num_commands; ++i) {
+            new_commands[i] = buffer->commands[i];
+        }
+
+        if (buffer->commands) {
+            PlatformFreeMemory(buffer->commands);
+        }
+
+        buffer->commands = new_commands;
+        buffer->capacity = new_capacity;
+    }
+
+    Command *command = &buffer->commands[buffer->num_commands];
+    buffer->num_commands += 1;
+    *command = {};
+    command->type = type;
+    command->entity = entity;
+    return command;
+}
+
+void
+RecordChangeMask(CommandBuffer *buffer, Entity entity, u32 clear_mask, u32 set_mask) {
+    // Back to back changes of the same entity are merged,
+    // so the entity only moves to another chunk once
+    if (buffer->num_commands > 0) {
+        Command *last = &buffer->commands[buffer->num_commands - 1];
+        if (last->type == COMMAND_CHANGE_MASK && last->entity == entity) {
+            last->clear_mask |= clear_mask;
+            last->set_mask = (last->set_mask & ~clear_mask) | set_mask;
+            return;
+        }
+    }
+
+    Command *command = PushCommand(buffer, COMMAND_CHANGE_MASK, entity);
+    command->clear_mask = clear_mask;
+    command->set_mask = set_mask;
+}
+
+Command *
+RecordCreateEntity(CommandBuffer *buffer, u32 mask) {
+    Command *command = PushCommand(buffer, COMMAND_CREATE_ENTITY, INVALID_ENTITY);
+    command->set_mask = mask;
+    return command;
+}
+
+void
+RecordDestroyEntity(CommandBuffer *buffer, Entity entity) {
+    PushCommand(buffer, COMMAND_DESTROY_ENTITY, entity);
+}
+
+void
+RecordSetMask(CommandBuffer *buffer, Entity entity, u32 mask) {
+    RecordChangeMask(buffer, entity, ~0u, mask);
+}
+
+void
+RecordAddComponents(CommandBuffer *buffer, Entity entity, u32 mask) {
+    RecordChangeMask(buffer, entity, 0, mask);
+}
+
+void
+RecordRemoveComponents(CommandBuffer *buffer, Entity entity, u32 mask) {
+    RecordChangeMask(buffer, entity, mask, 0);
+}
+
+void
+PlayCommands(World *world, CommandBuffer *buffer) {
+    for (u32 i = 0; i < buffer->num_commands; ++i) {
+        Command *command = &buffer->commands[i];
+        switch (command->type) {
+            case COMMAND_CREATE_ENTITY: {
+                Entity entity = CreateEntity(world);
+                SetMask(world, entity, command->set_mask);
+                SetTransform(world, entity, command->transform);
+                *GetSprite(world, entity) = command->sprite;
+                *GetAnimation(world, entity) = command->animation;
+                *GetMotion(world, entity) = command->motion;
+            } break;
+            case COMMAND_DESTROY_ENTITY: {
+                DestroyEntity(world, command->entity);
+            } break;
+            case COMMAND_CHANGE_MASK: {
+                // An earlier command may have destroyed the entity
+                if (IsEntityAlive(world, command->entity)) {
+                    u32 mask = GetMask(world, command->entity);
+                    SetMask(world, command->entity, (mask & ~command->clear_mask) | command->set_mask);
+                }
+            } break;
+        }
+    }
+
+    buffer->num_commands = 0;
+}
+
+void
+ClearCommandBuffer(CommandBuffer *buffer) {
+    buffer->num_commands = 0;
+}
+
+void
+FreeCommandBuffer(CommandBuffer *buffer) {
+    if (buffer->commands) {
+        PlatformFreeMemory(buffer->commands);
+    }
+
+    *buffer = {};
+}
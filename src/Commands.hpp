@@ -0,0 +1,72 @@
+#ifndef PACMAN_COMMANDS_HPP
+#define PACMAN_COMMANDS_HPP
+#include "Common.hpp"
+#include "World.hpp"
+
+
+enum {
+    COMMAND_CREATE_ENTITY,
+    COMMAND_DESTROY_ENTITY,
+    COMMAND_CHANGE_MASK,
+};
+
+struct Command {
+    u32 type;
+    Entity entity;
+
+    // COMMAND_CHANGE_MASK sets the mask to (mask & ~clear_mask) | set_mask.
+    // COMMAND_CREATE_ENTITY uses set_mask and the components below.
+    u32 clear_mask;
+    u32 set_mask;
+    Transform transform;
+    Sprite sprite;
+    Animation animation;
+    Motion motion;
+};
+
+// Structural changes, i.e., creating and destroying entities and changing
+// masks, move rows between chunks. While systems run they are recorded
+// here instead and played back at a sync point, so no system sees the
+// chunks change under it.
+struct CommandBuffer {
+    Command *commands;
+    u32 num_commands;
+    u32 capacity;
+};
+
+
+// The entity is created when the buffer is played back, so its handle is
+// not known yet. Fill in the components of the returned command. The
+// pointer is only valid until the next command is recorded.
+Command *
+RecordCreateEntity(CommandBuffer *buffer, u32 mask);
+
+void
+RecordDestroyEntity(CommandBuffer *buffer, Entity entity);
+
+// Records a change of the mask to (mask & ~clear_mask) | set_mask
+void
+RecordChangeMask(CommandBuffer *buffer, Entity entity, u32 clear_mask, u32 set_mask);
+
+void
+RecordSetMask(CommandBuffer *buffer, Entity entity, u32 mask);
+
+void
+RecordAddComponents(CommandBuffer *buffer, Entity entity, u32 mask);
+
+void
+RecordRemoveComponents(CommandBuffer *buffer, Entity entity, u32 mask);
+
+// Applies the commands in the order they were recorded and empties the
+// buffer. Mask changes of entities that are destroyed by then are dropped.
+void
+PlayCommands(World *world, CommandBuffer *buffer);
+
+// Drops the commands without playing them back
+void
+ClearCommandBuffer(CommandBuffer *buffer);
+
+void
+FreeCommandBuffer(CommandBuffer *buffer);
+
+#endif // PACMAN_COMMANDS_HPP
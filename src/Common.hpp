@@ -11,6 +11,28 @@
 
 #define NOT_IMPLEMENTED ASSERT(0)
 
+// The SIMD instruction sets that code may use. SSE2 is part of every
+// target it is defined for. AVX2 code is compiled for every x64 target
+// without raising the target of the rest, and is only called when
+// PlatformHasAvx2 says the CPU has it, so AVX2_FUNCTION has to be on
+// every function that uses it. Code that uses either also has a scalar
+// version for other targets.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PACMAN_SSE2
+#endif
+
+#ifdef PACMAN_SSE2
+    #include <emmintrin.h>
+#endif
+
+#if defined(_M_X64) && !defined(_M_ARM64EC)
+    #define PACMAN_AVX2
+    #define AVX2_FUNCTION
+#elif defined(__x86_64__)
+    #define PACMAN_AVX2
+    #define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
 
 typedef signed char        s8;
 typedef short              s16;
@@ -23,4 +45,13 @@ typedef unsigned long long u64;
 typedef float              f32;
 typedef double             f64;
 
+// Goes in every spin loop, so that the other hardware
+// thread of the core gets to run while it spins
+inline void
+CpuPause() {
+#ifdef PACMAN_SSE2
+    _mm_pause();
+#endif
+}
+
 #endif // PACMAN_COMMON_HPP
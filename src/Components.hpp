@@ -1,15 +1,23 @@
 #ifndef PACMAN_COMPONENTS_HPP
 #define PACMAN_COMPONENTS_HPP
 #include "Math.hpp"
-#include "OpenGL.hpp"
 
 
+enum {
+    COMPONENT_TRANSFORM,
+    COMPONENT_SPRITE,
+    COMPONENT_ANIMATION,
+    COMPONENT_MOTION,
+
+    COMPONENT_COUNT
+};
+
 enum {
     MASK_NONE       = 0,
-    MASK_TRANSFORM  = 1 << 0,
-    MASK_SPRITE     = 1 << 1,
-    MASK_ANIMATION  = 1 << 2,
-    MASK_MOTION     = 1 << 3,
+    MASK_TRANSFORM  = 1 << COMPONENT_TRANSFORM,
+    MASK_SPRITE     = 1 << COMPONENT_SPRITE,
+    MASK_ANIMATION  = 1 << COMPONENT_ANIMATION,
+    MASK_MOTION     = 1 << COMPONENT_MOTION,
 };
 
 struct Transform {
@@ -17,9 +25,10 @@ struct Transform {
     Vector2 translate;
 };
 
+// The frames of the sprite sheet are numbered, see SPRITE_ID_*.
+// The render system looks up where the frame is in the texture.
 struct Sprite {
-    Texture2D texture;
-    VertexArray vertex_array;
+    u8 id;
 };
 
 struct Animation {
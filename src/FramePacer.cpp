@@ -0,0 +1,46 @@
+#include "FramePacer.hpp"
+
+
+void
+InitFramePacer(FramePacer *pacer, f32 frame_rate, f32 spin_seconds) {
+    *pacer = {};
+    s64 frequency = PlatformGetWallClockFrequency();
+    if (frame_rate > 0.0f) {
+        pacer->frame_period = static_cast<s64>(frequency / frame_rate);
+    }
+
+    pacer->spin_period = static_cast<s64>(frequency * spin_seconds);
+    pacer->last_frame_start = PlatformGetWallClock();
+    pacer->next_deadline = pacer->last_frame_start + pacer->frame_period;
+}
+
+f32
+WaitForNextFrame(FramePacer *pacer) {
+    s64 now = PlatformGetWallClock();
+    if (pacer->frame_period > 0) {
+        // Sleep until shortly before the deadline, then spin until it
+        s64 sleep_ticks = pacer->next_deadline - now - pacer->spin_period;
+        if (sleep_ticks > 0) {
+            PlatformSleep(PlatformGetSecondsElapsed(0, sleep_ticks));
+        }
+
+        now = PlatformGetWallClock();
+        while (now < pacer->next_deadline) {
+            CpuPause();
+            now = PlatformGetWallClock();
+        }
+
+        f32 error = PlatformGetSecondsElapsed(pacer->next_deadline, now);
+        pacer->last_error_seconds = error;
+        pacer->average_error_seconds += (error - pacer->average_error_seconds) * 0.05f;
+
+        pacer->next_deadline += pacer->frame_period;
+        if (now > pacer->next_deadline) {
+            pacer->next_deadline = now + pacer->frame_period;
+        }
+    }
+
+    f32 delta_time = PlatformGetSecondsElapsed(pacer->last_frame_start, now);
+    pacer->last_frame_start = now;
+    return delta_time;
+}
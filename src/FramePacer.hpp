@@ -0,0 +1,34 @@
+#ifndef PACMAN_FRAME_PACER_HPP
+#define PACMAN_FRAME_PACER_HPP
+#include "Common.hpp"
+#include "Platform.hpp"
+
+
+// Sleeps overshoot by up to a scheduler tick, so the end of every
+// wait is spun instead
+constexpr f32 DEFAULT_FRAME_PACER_SPIN_SECONDS = 0.002f;
+
+// Starts the frames at a fixed rate. Every frame has a deadline one
+// period after the one before it, so an early or late frame does not
+// move the frames after it. A frame that is more than a whole period
+// late starts a new schedule instead of rushing to catch up.
+struct FramePacer {
+    s64 frame_period; // In wall clock ticks, 0 runs as fast as possible
+    s64 spin_period;
+    s64 next_deadline;
+    s64 last_frame_start;
+    f32 last_error_seconds; // How late the last frame started, the spin never starts one early
+    f32 average_error_seconds; // Moving average of last_error_seconds
+};
+
+
+// A frame_rate of 0 does not wait at all
+void
+InitFramePacer(FramePacer *pacer, f32 frame_rate, f32 spin_seconds);
+
+// Waits for the deadline of the next frame. Returns the seconds since
+// the last frame started.
+f32
+WaitForNextFrame(FramePacer *pacer);
+
+#endif // PACMAN_FRAME_PACER_HPP
@@ -1,13 +1,40 @@
 #ifndef PACMAN_GAME_HPP
 #define PACMAN_GAME_HPP
 #include "Common.hpp"
+#include "Maze.hpp"
 #include "Platform.hpp"
+#include "Scheduler.hpp"
+#include "Systems.hpp"
+#include "World.hpp"
 
 
+// Everything a game changes while it runs. Games do not share any state,
+// so a process can run as many of them as it likes. The systems point
+// into the GameState, so it must not move after GameInit.
+struct GameState {
+    World world; // Only changes in GameUpdate, so it can be drawn between updates
+    Maze maze;
+    Scheduler scheduler;
+    PlayerInputSystem player_input_system;
+    GhostAiSystem ghost_ai_system;
+};
+
+
+// The systems run as jobs, so InitJobSystem has to be called first.
+// A game can be updated from the thread that called InitJobSystem or
+// from a job, but only by one of them at a time.
+void
+GameInit(GameState *game, s32 window_width, s32 window_height);
+
+// Starts the game over in the memory it already has, which is
+// cheaper than FreeGame and GameInit
+void
+ResetGame(GameState *game);
+
 void
-GameInit(s32 window_width, s32 window_height);
+GameUpdate(GameState *game, f32 delta_time, Input input);
 
 void
-GameUpdate(f32 delta_time, Input input);
+FreeGame(GameState *game);
 
 #endif // PACMAN_GAME_HPP
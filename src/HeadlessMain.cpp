@@ -0,0 +1,341 @@
+#ifdef PACMAN_HEADLESS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Batch.hpp"
+#include "Common.hpp"
+#include "Game.hpp"
+#include "Jobs.hpp"
+#include "OpenGL.hpp"
+#include "Platform.hpp"
+#include "RenderSystem.hpp"
+#include "SoftwareRenderer.hpp"
+// After glad, which has to come before the OpenGL headers
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+
+// Runs the game without a window, as fast as it can, for CI and for
+// running many games on machines without a display. Every tick is one
+// frame at 60 Hz, and the input follows a script, so two runs with the
+// same arguments make the same frames.
+constexpr s32 WINDOW_WIDTH = 800;
+constexpr s32 WINDOW_HEIGHT = WINDOW_WIDTH;
+constexpr f32 TICK_SECONDS = 1.0f / 60.0f;
+constexpr u32 DEFAULT_TICKS = 3600;
+constexpr u32 MAX_SCRIPT_STEPS = 256;
+constexpr u32 BATCH_ACTION_TICKS = 30; // How long a random action is held in --batch
+constexpr u32 BATCH_MAX_TICKS = 60 * 60;
+static GameState game;
+
+// Pacman changes direction every one and a half seconds
+static char DEFAULT_SCRIPT[] = "a:90,w:90,d:90,s:90,a:90,d:90,w:90,a:90";
+
+enum {
+    HEADLESS_RENDERER_SOFTWARE,
+    HEADLESS_RENDERER_OPENGL, // Needs EGL_MESA_platform_surfaceless
+    HEADLESS_RENDERER_NONE, // Records the frames, but does not draw them
+};
+
+// A key is held for num_ticks, then the next step starts. The script
+// starts over when it ends.
+struct ScriptStep {
+    s32 key;
+    u32 num_ticks;
+};
+
+struct InputScript {
+    ScriptStep steps[MAX_SCRIPT_STEPS];
+    u32 num_steps;
+    u32 num_ticks;
+};
+
+struct HeadlessRenderThread {
+    u32 renderer;
+    RenderBackend backend;
+    RenderQueue *queue;
+    EGLDisplay display;
+    EGLContext gl_rendering_context;
+    u32 *screen_pixels; // The last frame, read back when the queue is closed
+    u32 num_drawn_frames; // The rest were dropped by the render queue
+    void *stopped; // Semaphore, signaled when the last frame was read back
+};
+
+
+// Parses steps like "a:90,w:30", where the keys are the ones of the game
+// and "-" releases them
+static bool
+ParseInputScript(char *text, InputScript *script) {
+    *script = {};
+    char *c = text;
+    while (*c) {
+        ScriptStep step;
+        switch (*c) {
+            case 'a': { step.key = KEY_A; } break;
+            case 'd': { step.key = KEY_D; } break;
+            case 's': { step.key = KEY_S; } break;
+            case 'w': { step.key = KEY_W; } break;
+            case '-': { step.key = KEY_NONE; } break;
+            default: { return false; }
+        }
+
+        c += 1;
+        if (*c != ':') {
+            return false;
+        }
+
+        char *end;
+        step.num_ticks = static_cast<u32>(strtoul(c + 1, &end, 10));
+        if (end == c + 1 || step.num_ticks == 0 || script->num_steps == MAX_SCRIPT_STEPS) {
+            return false;
+        }
+
+        script->steps[script->num_steps] = step;
+        script->num_steps += 1;
+        script->num_ticks += step.num_ticks;
+        c = (*end == ',') ? end + 1 : end;
+    }
+
+    return script->num_steps > 0;
+}
+
+static void
+ApplyInputScript(InputScript *script, u32 tick, Input *input) {
+    u32 script_tick = tick % script->num_ticks;
+    ScriptStep *step = &script->steps[0];
+    for (u32 i = 0; i < script->num_steps; ++i) {
+        step = &script->steps[i];
+        if (script_tick < step->num_ticks) {
+            break;
+        }
+
+        script_tick -= step->num_ticks;
+    }
+
+    for (s32 key = 0; key < KEY_COUNT; ++key) {
+        input->is_key_down[key] = (key == step->key) && (key != KEY_NONE);
+    }
+
+    input->last_pressed_key = step->key;
+}
+
+// A context without a surface, so the screen is a framebuffer of its own
+static void
+HeadlessInitOpenGL(HeadlessRenderThread *thread) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (eglGetPlatformDisplayEXT) {
+        display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+    }
+
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0) || !eglBindAPI(EGL_OPENGL_API)) {
+        PlatformShowErrorAndExit("Could not open a surfaceless EGL display");
+    }
+
+    EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    EGLContext gl_rendering_context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+    if (gl_rendering_context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, gl_rendering_context)) {
+        PlatformShowErrorAndExit("OpenGL context error");
+    }
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+        NOT_IMPLEMENTED;
+    }
+
+    RenderTarget screen = MakeRenderTarget(WINDOW_WIDTH, WINDOW_HEIGHT);
+    BindFramebuffer(screen.framebuffer_id);
+    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    thread->display = display;
+    thread->gl_rendering_context = gl_rendering_context;
+}
+
+static void
+HeadlessRunRenderThread(void *data) {
+    HeadlessRenderThread *thread = static_cast<HeadlessRenderThread *>(data);
+    if (thread->renderer == HEADLESS_RENDERER_OPENGL) {
+        eglMakeCurrent(thread->display, EGL_NO_SURFACE, EGL_NO_SURFACE, thread->gl_rendering_context);
+    }
+
+    while (RenderCommandList *list = BeginReadRenderCommands(thread->queue)) {
+        if (thread->renderer != HEADLESS_RENDERER_NONE) {
+            ExecuteRenderCommands(&thread->backend, list);
+        }
+
+        thread->num_drawn_frames += 1;
+        EndReadRenderCommands(thread->queue);
+    }
+
+    // Both renderers store the pixels as 0xAARRGGBB, bottom up
+    switch (thread->renderer) {
+        case HEADLESS_RENDERER_SOFTWARE: {
+            SoftwareRenderer *renderer = static_cast<SoftwareRenderer *>(thread->backend.data);
+            u32 *pixels = renderer->targets[RENDER_TARGET_SCREEN];
+            for (s32 i = 0; i < WINDOW_WIDTH * WINDOW_HEIGHT; ++i) {
+                thread->screen_pixels[i] = pixels[i];
+            }
+        } break;
+        case HEADLESS_RENDERER_OPENGL: {
+            glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, thread->screen_pixels);
+            eglMakeCurrent(thread->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        } break;
+    }
+
+    PlatformSignalSemaphore(thread->stopped, 1);
+}
+
+// FNV-1a, to compare the last frame of two runs
+static u64
+HashPixels(u32 *pixels, u32 num_pixels) {
+    u64 hash = 14695981039346656037ull;
+    for (u32 i = 0; i < num_pixels; ++i) {
+        hash ^= pixels[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// Steps num_games games without drawing them, with random actions, to
+// measure how many ticks a BatchStep makes per second and per thread
+static void
+RunBatch(u32 num_games, u32 num_ticks) {
+    GameBatch batch;
+    InitGameBatch(&batch, num_games, WINDOW_WIDTH, WINDOW_HEIGHT, BATCH_MAX_TICKS);
+    u8 *actions = static_cast<u8 *>(PlatformAllocateMemory(num_games));
+    u32 random_state = 1;
+    f64 points = 0.0;
+    u32 num_done = 0;
+    s64 start = PlatformGetWallClock();
+    for (u32 tick = 0; tick < num_ticks; ++tick) {
+        if (tick % BATCH_ACTION_TICKS == 0) {
+            for (u32 i = 0; i < num_games; ++i) {
+                random_state ^= random_state << 13;
+                random_state ^= random_state >> 17;
+                random_state ^= random_state << 5;
+                actions[i] = static_cast<u8>(random_state % DIRECTION_NONE);
+            }
+        }
+
+        BatchStep(&batch, actions);
+        for (u32 i = 0; i < num_games; ++i) {
+            points += batch.rewards[i];
+            num_done += batch.dones[i];
+        }
+    }
+
+    f32 seconds = PlatformGetSecondsElapsed(start, PlatformGetWallClock());
+    f32 game_ticks = static_cast<f32>(num_games) * static_cast<f32>(num_ticks);
+    u32 num_threads = GetWorkerCount() + 1;
+    printf("%u games x %u ticks in %.3f s, %.0f game-ticks/s, %.0f per thread on %u threads\n",
+           num_games, num_ticks, seconds, game_ticks / seconds, game_ticks / seconds / num_threads, num_threads);
+    printf("%u games done, %.0f points\n", num_done, points);
+    FreeGameBatch(&batch);
+    PlatformFreeMemory(actions);
+}
+
+static void
+PrintUsage() {
+    fprintf(stderr,
+            "usage: pacman_headless [--ticks N] [--renderer software|opengl|none] [--script STEPS] [--batch GAMES]\n"
+            "  STEPS are key:ticks separated by commas, with the keys a, d, s, w, and - for none.\n"
+            "  The default is %s\n"
+            "  --batch steps GAMES games at once with random input instead, and does not draw them.\n", DEFAULT_SCRIPT);
+}
+
+
+s32
+main(s32 argc, char **argv) {
+    u32 num_ticks = DEFAULT_TICKS;
+    u32 renderer = HEADLESS_RENDERER_SOFTWARE;
+    char *script_text = DEFAULT_SCRIPT;
+    u32 num_games = 0;
+    for (s32 i = 1; i < argc; ++i) {
+        char *value = (i + 1 < argc) ? argv[i + 1] : 0;
+        if (strcmp(argv[i], "--ticks") == 0 && value) {
+            num_ticks = static_cast<u32>(strtoul(value, 0, 10));
+        } else if (strcmp(argv[i], "--renderer") == 0 && value && strcmp(value, "software") == 0) {
+            renderer = HEADLESS_RENDERER_SOFTWARE;
+        } else if (strcmp(argv[i], "--renderer") == 0 && value && strcmp(value, "opengl") == 0) {
+            renderer = HEADLESS_RENDERER_OPENGL;
+        } else if (strcmp(argv[i], "--renderer") == 0 && value && strcmp(value, "none") == 0) {
+            renderer = HEADLESS_RENDERER_NONE;
+        } else if (strcmp(argv[i], "--script") == 0 && value) {
+            script_text = value;
+        } else if (strcmp(argv[i], "--batch") == 0 && value) {
+            num_games = static_cast<u32>(strtoul(value, 0, 10));
+        } else {
+            PrintUsage();
+            return 1;
+        }
+
+        i += 1;
+    }
+
+    InputScript script;
+    if (!ParseInputScript(script_text, &script)) {
+        PrintUsage();
+        return 1;
+    }
+
+    // The main thread also runs jobs, so it is not counted as a worker
+    InitJobSystem(PlatformGetProcessorCount() - 1);
+    if (num_games > 0) {
+        RunBatch(num_games, num_ticks);
+        return 0;
+    }
+
+    HeadlessRenderThread render_thread = {};
+    render_thread.renderer = renderer;
+    SoftwareRenderer software_renderer;
+    OpenGLRenderer opengl_renderer;
+    switch (renderer) {
+        case HEADLESS_RENDERER_SOFTWARE: {
+            render_thread.backend = InitSoftwareRenderer(&software_renderer, { WINDOW_WIDTH, WINDOW_HEIGHT });
+        } break;
+        case HEADLESS_RENDERER_OPENGL: {
+            HeadlessInitOpenGL(&render_thread);
+            render_thread.backend = InitOpenGLRenderer(&opengl_renderer, { WINDOW_WIDTH, WINDOW_HEIGHT });
+            eglMakeCurrent(render_thread.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        } break;
+    }
+
+    RenderQueue render_queue;
+    InitRenderQueue(&render_queue);
+    render_thread.queue = &render_queue;
+    render_thread.screen_pixels = static_cast<u32 *>(PlatformAllocateMemory(WINDOW_WIDTH * WINDOW_HEIGHT * sizeof(u32)));
+    render_thread.stopped = PlatformCreateSemaphore(0);
+    PlatformStartThread(HeadlessRunRenderThread, &render_thread);
+
+    GameInit(&game, WINDOW_WIDTH, WINDOW_HEIGHT);
+    RenderSystem render_system = {};
+    InitRenderSystem(&render_system, "sprites\\spritesheet.bmp");
+    Input input = {};
+    s64 start = PlatformGetWallClock();
+    for (u32 tick = 0; tick < num_ticks; ++tick) {
+        ApplyInputScript(&script, tick, &input);
+        GameUpdate(&game, TICK_SECONDS, input);
+        UpdateRenderSystem(&game.world, &render_system, &render_queue);
+    }
+
+    FlushRenderQueue(&render_queue);
+    f32 seconds = PlatformGetSecondsElapsed(start, PlatformGetWallClock());
+    CloseRenderQueue(&render_queue);
+    PlatformWaitSemaphore(render_thread.stopped);
+
+    printf("%u ticks in %.3f s, %.1f ticks/s, %u frames drawn\n", num_ticks, seconds, num_ticks / seconds, render_thread.num_drawn_frames);
+    if (renderer != HEADLESS_RENDERER_NONE) {
+        printf("last frame %016llx\n", HashPixels(render_thread.screen_pixels, WINDOW_WIDTH * WINDOW_HEIGHT));
+    }
+
+    return 0;
+}
+
+#endif // PACMAN_HEADLESS
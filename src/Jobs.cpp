@@ -0,0 +1,279 @@
+#include "Jobs.hpp"
+#include "Platform.hpp"
+
+
+constexpr u32 MAX_THREADS = 64;
+constexpr u32 DEQUE_SIZE = 1024; // Must be a power of two
+
+// How long WaitForCounter spins before it sleeps. Most jobs take a few
+// microseconds, and a sleeping thread takes longer than that to wake up.
+constexpr u32 WAIT_SPIN_COUNT = 2048;
+
+struct Job {
+    JobFunction *function;
+    ParallelForFunction *range_function; // Set instead of function for ParallelFor
+    void *data;
+    u32 begin;
+    u32 end;
+    u32 grain;
+    JobCounter *counter;
+};
+
+// A Chase-Lev deque. Only the owner pushes and pops at the bottom, and
+// the other threads steal at the top. top and bottom are on their own
+// cache lines so that thieves do not slow down the owner.
+struct JobDeque {
+    alignas(64) std::atomic<s64> top;
+    alignas(64) std::atomic<s64> bottom;
+    alignas(64) Job jobs[DEQUE_SIZE];
+};
+
+struct JobSystem {
+    JobDeque *deques; // One for every thread, the main thread has the first one
+    u32 num_threads;
+    u32 thread_indices[MAX_THREADS];
+    std::atomic<u32> num_sleeping;
+    void *semaphore; // Idle workers sleep on it until a job is added
+
+    // Semaphores for WaitForCounter, one for every thread. A wake up on
+    // the shared one could be taken by a worker that is going to sleep.
+    void *counter_semaphores[MAX_THREADS];
+};
+
+
+static JobSystem job_system;
+static thread_local u32 thread_index;
+static thread_local u32 random_state;
+static thread_local u64 num_pushed_jobs;
+
+
+static void
+PushJob(JobDeque *deque, Job job) {
+    s64 bottom = deque->bottom.load(std::memory_order_relaxed);
+    ASSERT(bottom - deque->top.load(std::memory_order_acquire) < static_cast<s64>(DEQUE_SIZE));
+    deque->jobs[bottom & (DEQUE_SIZE - 1)] = job;
+    deque->bottom.store(bottom + 1, std::memory_order_release);
+    num_pushed_jobs += 1;
+}
+
+static bool
+PopJob(JobDeque *deque, Job *job) {
+    s64 bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    s64 top = deque->top.load(std::memory_order_relaxed);
+    if (top > bottom) {
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    *job = deque->jobs[bottom & (DEQUE_SIZE - 1)];
+    if (top == bottom) {
+        // This is the last job, so a thief might be taking it too
+        bool is_taken = deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        return is_taken;
+    }
+
+    return true;
+}
+
+static bool
+StealJob(JobDeque *deque, Job *job) {
+    s64 top = deque->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    s64 bottom = deque->bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return false;
+    }
+
+    *job = deque->jobs[top & (DEQUE_SIZE - 1)];
+    return deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+static bool
+FindJob(Job *job) {
+    if (PopJob(&job_system.deques[thread_index], job)) {
+        return true;
+    }
+
+    // Xorshift, so that the thieves do not all start with the same victim
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    u32 num_threads = job_system.num_threads;
+    u32 offset = random_state % num_threads;
+    for (u32 i = 0; i < num_threads; ++i) {
+        u32 victim = (offset + i) % num_threads;
+        if (victim != thread_index && StealJob(&job_system.deques[victim], job)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+WakeWorker() {
+    // Pairs with the increment of num_sleeping in WorkerThread. Either the
+    // worker sees the new job before it sleeps, or we see that it sleeps.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (job_system.num_sleeping.load(std::memory_order_relaxed) > 0) {
+        PlatformSignalSemaphore(job_system.semaphore, 1);
+    }
+}
+
+static void
+RunJob(Job job) {
+    if (job.range_function) {
+        while (job.end - job.begin > job.grain) {
+            Job upper_half = job;
+            upper_half.begin = job.begin + (job.end - job.begin) / 2;
+            job.end = upper_half.begin;
+            job.counter->remaining.fetch_add(1, std::memory_order_relaxed);
+            PushJob(&job_system.deques[thread_index], upper_half);
+            WakeWorker();
+        }
+
+        job.range_function(job.data, job.begin, job.end);
+    }
+    else {
+        job.function(job.data);
+    }
+
+    SignalCounter(job.counter);
+}
+
+static void
+WorkerThread(void *data) {
+    thread_index = *static_cast<u32 *>(data);
+    random_state = thread_index * 2654435761u + 1;
+    for (;;) {
+        Job job;
+        if (FindJob(&job)) {
+            RunJob(job);
+            continue;
+        }
+
+        job_system.num_sleeping.fetch_add(1, std::memory_order_seq_cst);
+        if (FindJob(&job)) {
+            job_system.num_sleeping.fetch_sub(1, std::memory_order_relaxed);
+            RunJob(job);
+            continue;
+        }
+
+        PlatformWaitSemaphore(job_system.semaphore);
+        job_system.num_sleeping.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void
+InitJobSystem(u32 num_workers) {
+    if (num_workers > MAX_THREADS - 1) {
+        num_workers = MAX_THREADS - 1;
+    }
+
+    job_system.num_threads = num_workers + 1;
+    job_system.deques = static_cast<JobDeque *>(PlatformAllocateMemory(job_system.num_threads * sizeof(JobDeque)));
+    job_system.semaphore = PlatformCreateSemaphore(0);
+    for (u32 i = 0; i < job_system.num_threads; ++i) {
+        job_system.counter_semaphores[i] = PlatformCreateSemaphore(0);
+    }
+
+    thread_index = 0;
+    random_state = 1;
+    for (u32 i = 1; i < job_system.num_threads; ++i) {
+        job_system.thread_indices[i] = i;
+        PlatformStartThread(WorkerThread, &job_system.thread_indices[i]);
+    }
+}
+
+u32
+GetWorkerCount() {
+    return job_system.num_threads - 1;
+}
+
+u64
+GetPushedJobCount() {
+    return num_pushed_jobs;
+}
+
+void
+AddJob(JobFunction *function, void *data, JobCounter *counter) {
+    Job job = {};
+    job.function = function;
+    job.data = data;
+    job.counter = counter;
+    counter->remaining.fetch_add(1, std::memory_order_relaxed);
+    PushJob(&job_system.deques[thread_index], job);
+    WakeWorker();
+}
+
+bool
+SignalCounter(JobCounter *counter) {
+    // The counter may be gone once the count is 0, unless a thread sleeps
+    // on it, which cannot wake up before it is signaled
+    u32 remaining = counter->remaining.fetch_sub(1, std::memory_order_acq_rel);
+    if (remaining == (JOB_COUNTER_SLEEPING | 1)) {
+        PlatformSignalSemaphore(job_system.counter_semaphores[counter->sleeping_thread], 1);
+    }
+
+    return (remaining & ~JOB_COUNTER_SLEEPING) == 1;
+}
+
+void
+WaitForCounter(JobCounter *counter) {
+    u32 num_spins = 0;
+    while ((counter->remaining.load(std::memory_order_acquire) & ~JOB_COUNTER_SLEEPING) > 0) {
+        Job job;
+        if (FindJob(&job)) {
+            RunJob(job);
+            num_spins = 0;
+        }
+        else if (num_spins < WAIT_SPIN_COUNT) {
+            CpuPause();
+            num_spins += 1;
+        }
+        else {
+            // The jobs that are left run on other threads, which do not
+            // need this one, since only a thread adds jobs to its deque.
+            // The last of them signals, unless it finished before the flag
+            // was set.
+            counter->sleeping_thread = thread_index;
+            if (counter->remaining.fetch_or(JOB_COUNTER_SLEEPING, std::memory_order_acq_rel) > 0) {
+                PlatformWaitSemaphore(job_system.counter_semaphores[thread_index]);
+            }
+
+            counter->remaining.fetch_and(~JOB_COUNTER_SLEEPING, std::memory_order_relaxed);
+            num_spins = 0;
+        }
+    }
+}
+
+void
+ParallelFor(u32 count, u32 grain, ParallelForFunction *function, void *data) {
+    if (grain == 0) {
+        grain = 1;
+    }
+
+    if (count <= grain || job_system.num_threads == 1) {
+        if (count > 0) {
+            function(data, 0, count);
+        }
+
+        return;
+    }
+
+    JobCounter counter;
+    counter.remaining = 1;
+
+    Job job = {};
+    job.range_function = function;
+    job.data = data;
+    job.begin = 0;
+    job.end = count;
+    job.grain = grain;
+    job.counter = &counter;
+    RunJob(job);
+    WaitForCounter(&counter);
+}
@@ -0,0 +1,59 @@
+#ifndef PACMAN_JOBS_HPP
+#define PACMAN_JOBS_HPP
+#include <atomic>
+#include "Common.hpp"
+
+
+typedef void JobFunction(void *data);
+typedef void ParallelForFunction(void *data, u32 begin, u32 end);
+
+// Counts the jobs that have not finished yet.
+// A counter must outlive the jobs that were added with it.
+struct JobCounter {
+    std::atomic<u32> remaining; // JOB_COUNTER_SLEEPING is set while a thread sleeps in WaitForCounter
+    u32 sleeping_thread;
+};
+
+constexpr u32 JOB_COUNTER_SLEEPING = 1u << 31;
+
+
+// Starts num_workers threads. The calling thread becomes the main thread.
+// With 0 workers every job runs on the thread that waits for it.
+void
+InitJobSystem(u32 num_workers);
+
+u32
+GetWorkerCount();
+
+// How many jobs the calling thread has pushed to its deque, the upper
+// halves that ParallelFor left to steal included
+u64
+GetPushedJobCount();
+
+// Any thread can add jobs. Every thread has its own deque of jobs. It
+// takes the newest job from its own deque, and when that is empty it
+// steals the oldest job from the deque of another thread.
+void
+AddJob(JobFunction *function, void *data, JobCounter *counter);
+
+// Counts one thing the counter waits for as done, like a job that
+// finishes. For counters of things that are not jobs, which start at
+// their count. Returns true if it was the last one.
+bool
+SignalCounter(JobCounter *counter);
+
+// Runs other jobs while waiting. When there are none, it spins for a
+// while, and then sleeps until the last job of the counter finishes.
+// Only one thread may wait for a counter at a time.
+void
+WaitForCounter(JobCounter *counter);
+
+// Calls function(data, begin, end) for ranges that cover [0, count) and
+// are at most grain long, spread over all threads. The range is split in
+// halves and the upper half is left for other threads to steal, so busy
+// threads keep their work and idle threads take large pieces. Returns
+// when every range is done.
+void
+ParallelFor(u32 count, u32 grain, ParallelForFunction *function, void *data);
+
+#endif // PACMAN_JOBS_HPP
@@ -0,0 +1,200 @@
+#if defined(__linux__) && !defined(PACMAN_HEADLESS) && !defined(PACMAN_TESTS)
+#include <stdio.h>
+#include "Common.hpp"
+#include "FramePacer.hpp"
+#include "Game.hpp"
+#include "Jobs.hpp"
+#include "OpenGL.hpp"
+#include "Platform.hpp"
+#include "RenderSystem.hpp"
+// After glad, which has to come before the OpenGL headers
+#include <GL/glx.h>
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/keysym.h>
+
+
+constexpr s32 WINDOW_WIDTH = 800;
+constexpr s32 WINDOW_HEIGHT = WINDOW_WIDTH;
+// The render queue never waits for the render thread, so the frame
+// pacer is what keeps the main loop from spinning
+constexpr f32 TARGET_FRAME_RATE = 60.0f;
+static_assert(TARGET_FRAME_RATE > 0.0f, "The main loop needs a frame rate");
+constexpr s32 SWAP_INTERVAL = 1; // Vertical blanks glXSwapBuffers waits for, 0 does not wait
+static bool is_window_open = true;
+static GameState game;
+
+// The render thread owns the OpenGL context once the game is running
+struct LinuxRenderThread {
+    Display *display;
+    Window window;
+    GLXContext gl_rendering_context;
+    RenderBackend backend;
+    RenderQueue *queue;
+    void *stopped; // Semaphore, signaled when the context is released
+};
+
+typedef void LinuxSwapIntervalFunction(Display *display, GLXDrawable drawable, int interval);
+
+
+static void
+LinuxProcessEvents(Display *display, Atom delete_window, Input *input) {
+    while (XPending(display)) {
+        XEvent event;
+        XNextEvent(display, &event);
+        switch (event.type) {
+            case KeyPress:
+            case KeyRelease: {
+                bool is_key_down = event.type == KeyPress;
+                KeySym key_sym = XLookupKeysym(&event.xkey, 0);
+                #define SET_KEY(key) input->is_key_down[key] = is_key_down; input->last_pressed_key = key
+                switch (key_sym) {
+                    case XK_a: { SET_KEY(KEY_A); } break;
+                    case XK_d: { SET_KEY(KEY_D); } break;
+                    case XK_s: { SET_KEY(KEY_S); } break;
+                    case XK_w: { SET_KEY(KEY_W); } break;
+                    case XK_Escape: { is_window_open = false; } break;
+                }
+            } break;
+            // Sent by the window manager when the window is being closed,
+            // e.g., the 'X' button is pressed
+            case ClientMessage: {
+                if (static_cast<Atom>(event.xclient.data.l[0]) == delete_window) {
+                    is_window_open = false;
+                }
+            } break;
+        }
+    }
+}
+
+static Window
+LinuxCreateWindow(Display *display, XVisualInfo *visual) {
+    Window root = DefaultRootWindow(display);
+    XSetWindowAttributes attributes = {};
+    attributes.colormap = XCreateColormap(display, root, visual->visual, AllocNone);
+    attributes.event_mask = KeyPressMask | KeyReleaseMask;
+
+    Window window = XCreateWindow(
+        display, root,
+        0, 0,
+        WINDOW_WIDTH, WINDOW_HEIGHT,
+        0, visual->depth, InputOutput, visual->visual,
+        CWColormap | CWEventMask, &attributes
+    );
+
+    if (!window) {
+        PlatformShowErrorAndExit("Could not create window");
+    }
+
+    XStoreName(display, window, "Pacman");
+    XMapWindow(display, window);
+    return window;
+}
+
+static void
+LinuxRunRenderThread(void *data) {
+    LinuxRenderThread *thread = static_cast<LinuxRenderThread *>(data);
+    if (!glXMakeCurrent(thread->display, thread->window, thread->gl_rendering_context)) {
+        PlatformShowErrorAndExit("OpenGL context error");
+    }
+
+    // GLX_EXT_swap_control
+    LinuxSwapIntervalFunction *glXSwapIntervalEXT = reinterpret_cast<LinuxSwapIntervalFunction *>(
+        glXGetProcAddressARB(reinterpret_cast<const GLubyte *>("glXSwapIntervalEXT")));
+    if (glXSwapIntervalEXT) {
+        glXSwapIntervalEXT(thread->display, thread->window, SWAP_INTERVAL);
+    }
+
+    // glXSwapBuffers waits here instead of in the simulation
+    while (RenderCommandList *list = BeginReadRenderCommands(thread->queue)) {
+        ExecuteRenderCommands(&thread->backend, list);
+        glXSwapBuffers(thread->display, thread->window);
+        EndReadRenderCommands(thread->queue);
+    }
+
+    glXMakeCurrent(thread->display, None, 0);
+    PlatformSignalSemaphore(thread->stopped, 1);
+}
+
+
+s32
+main() {
+    // The render thread swaps buffers while the main thread reads events
+    XInitThreads();
+    Display *display = XOpenDisplay(0);
+    if (!display) {
+        PlatformShowErrorAndExit("Could not open display");
+    }
+
+    s32 visual_attributes[] = { GLX_RGBA, GLX_DOUBLEBUFFER, GLX_RED_SIZE, 8, GLX_GREEN_SIZE, 8, GLX_BLUE_SIZE, 8, GLX_ALPHA_SIZE, 8, None };
+    XVisualInfo *visual = glXChooseVisual(display, DefaultScreen(display), visual_attributes);
+    if (!visual) {
+        PlatformShowErrorAndExit("OpenGL context error");
+    }
+
+    Window window = LinuxCreateWindow(display, visual);
+    Atom delete_window = XInternAtom(display, "WM_DELETE_WINDOW", false);
+    XSetWMProtocols(display, window, &delete_window, 1);
+    // Holding a key sends repeated presses, but no releases in between
+    XkbSetDetectableAutoRepeat(display, true, 0);
+
+    GLXContext gl_rendering_context = glXCreateContext(display, visual, 0, true);
+    if (!gl_rendering_context || !glXMakeCurrent(display, window, gl_rendering_context)) {
+        PlatformShowErrorAndExit("OpenGL context error");
+    }
+
+    if (!gladLoadGL()) {
+        NOT_IMPLEMENTED;
+    }
+
+    OpenGLRenderer renderer;
+    RenderQueue render_queue;
+    InitRenderQueue(&render_queue);
+    LinuxRenderThread render_thread;
+    render_thread.display = display;
+    render_thread.window = window;
+    render_thread.gl_rendering_context = gl_rendering_context;
+    render_thread.backend = InitOpenGLRenderer(&renderer, { WINDOW_WIDTH, WINDOW_HEIGHT });
+    render_thread.queue = &render_queue;
+    render_thread.stopped = PlatformCreateSemaphore(0);
+    glXMakeCurrent(display, None, 0);
+    PlatformStartThread(LinuxRunRenderThread, &render_thread);
+
+    // The main thread also runs jobs, so it is not counted as a worker
+    InitJobSystem(PlatformGetProcessorCount() - 1);
+    GameInit(&game, WINDOW_WIDTH, WINDOW_HEIGHT);
+    RenderSystem render_system = {};
+    InitRenderSystem(&render_system, "sprites\\spritesheet.bmp");
+    Input input = {};
+    f32 delta_time = 0.016f;
+    FramePacer pacer;
+    InitFramePacer(&pacer, TARGET_FRAME_RATE, DEFAULT_FRAME_PACER_SPIN_SECONDS);
+
+    s64 title_time = PlatformGetWallClock();
+    while (is_window_open) {
+        LinuxProcessEvents(display, delete_window, &input);
+        GameUpdate(&game, delta_time, input);
+        UpdateRenderSystem(&game.world, &render_system, &render_queue);
+        delta_time = WaitForNextFrame(&pacer);
+
+        if (PlatformGetSecondsElapsed(title_time, pacer.last_frame_start) >= 1.0f) {
+            RenderStats stats = render_system.stats;
+            char title[160];
+            snprintf(title, sizeof(title), "Pacman - pacing error %.2f ms - GPU: static layer %.2f ms, screen %.2f ms, frame %.2f ms",
+                     pacer.average_error_seconds * 1000.0f, stats.static_layer_seconds * 1000.0f,
+                     stats.screen_seconds * 1000.0f, stats.frame_seconds * 1000.0f);
+            XStoreName(display, window, title);
+            title_time = pacer.last_frame_start;
+        }
+    }
+
+    CloseRenderQueue(&render_queue);
+    PlatformWaitSemaphore(render_thread.stopped);
+    glXDestroyContext(display, gl_rendering_context);
+    XDestroyWindow(display, window);
+    XFree(visual);
+    XCloseDisplay(display);
+    return 0;
+}
+
+#endif // __linux__ && !PACMAN_HEADLESS && !PACMAN_TESTS
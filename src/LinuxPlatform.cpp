@@ -0,0 +1,193 @@
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "Common.hpp"
+#include "Platform.hpp"
+
+
+constexpr u32 MAX_FILE_NAME = 512;
+
+
+File
+PlatformReadFile(char *file_name) {
+    // The file names of the game use Windows separators
+    char path[MAX_FILE_NAME];
+    u32 length = 0;
+    for (; file_name[length] && length < MAX_FILE_NAME - 1; ++length) {
+        path[length] = (file_name[length] == '\\') ? '/' : file_name[length];
+    }
+
+    path[length] = 0;
+
+    // The file is mapped instead of copied, and the pages are only read
+    // in when they are first touched
+    void *buffer = MAP_FAILED;
+    u64 file_bytes = 0;
+    s32 file_descriptor = open(path, O_RDONLY);
+    if (file_descriptor >= 0) {
+        struct stat file_status;
+        if (fstat(file_descriptor, &file_status) == 0 && file_status.st_size > 0) {
+            file_bytes = static_cast<u64>(file_status.st_size);
+            buffer = mmap(0, file_bytes, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        }
+
+        close(file_descriptor);
+    }
+
+    if (buffer == MAP_FAILED) {
+        PlatformShowErrorAndExit("Could not open file");
+    }
+
+    File file;
+    file.buffer = buffer;
+    file.size = file_bytes;
+    return file;
+}
+
+void
+PlatformFreeFile(File file) {
+    ASSERT(file.buffer);
+    munmap(file.buffer, file.size);
+}
+
+// munmap needs the size, so it is stored in a page of its own in front
+// of the memory, which keeps the memory on a page boundary
+void *
+PlatformAllocateMemory(u64 size) {
+    u64 page_size = static_cast<u64>(sysconf(_SC_PAGESIZE));
+    void *pages = mmap(0, size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED) {
+        PlatformShowErrorAndExit("Could not allocate memory");
+    }
+
+    *static_cast<u64 *>(pages) = size + page_size;
+    return static_cast<u8 *>(pages) + page_size;
+}
+
+void
+PlatformFreeMemory(void *memory) {
+    ASSERT(memory);
+    u64 page_size = static_cast<u64>(sysconf(_SC_PAGESIZE));
+    void *pages = static_cast<u8 *>(memory) - page_size;
+    munmap(pages, *static_cast<u64 *>(pages));
+}
+
+void
+PlatformShowErrorAndExit(char *msg) {
+    fprintf(stderr, "Error: %s\n", msg);
+    exit(1);
+}
+
+struct LinuxThreadStart {
+    PlatformThreadFunction *function;
+    void *data;
+};
+
+static void *
+LinuxThreadProc(void *parameter) {
+    LinuxThreadStart *start = static_cast<LinuxThreadStart *>(parameter);
+    start->function(start->data);
+    return 0;
+}
+
+void
+PlatformStartThread(PlatformThreadFunction *function, void *data) {
+    // Threads run until the process exits, so start is never freed
+    LinuxThreadStart *start = static_cast<LinuxThreadStart *>(PlatformAllocateMemory(sizeof(LinuxThreadStart)));
+    start->function = function;
+    start->data = data;
+    pthread_t thread;
+    if (pthread_create(&thread, 0, LinuxThreadProc, start) != 0) {
+        PlatformShowErrorAndExit("Could not create thread");
+    }
+
+    pthread_detach(thread);
+}
+
+u32
+PlatformGetProcessorCount() {
+    return static_cast<u32>(sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+bool
+PlatformHasAvx2() {
+#if defined(__x86_64__) || defined(__i386__)
+    // The checks can run before the constructor that fills them in
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+void *
+PlatformCreateSemaphore(u32 initial_count) {
+    sem_t *semaphore = static_cast<sem_t *>(PlatformAllocateMemory(sizeof(sem_t)));
+    if (sem_init(semaphore, 0, initial_count) != 0) {
+        PlatformShowErrorAndExit("Could not create semaphore");
+    }
+
+    return semaphore;
+}
+
+void
+PlatformSignalSemaphore(void *semaphore, u32 count) {
+    for (u32 i = 0; i < count; ++i) {
+        sem_post(static_cast<sem_t *>(semaphore));
+    }
+}
+
+void
+PlatformWaitSemaphore(void *semaphore) {
+    // sem_wait returns early when a signal interrupts it
+    while (sem_wait(static_cast<sem_t *>(semaphore)) != 0) {
+    }
+}
+
+bool
+PlatformTryWaitSemaphore(void *semaphore) {
+    while (sem_trywait(static_cast<sem_t *>(semaphore)) != 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+s64
+PlatformGetWallClock() {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<s64>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+f32
+PlatformGetSecondsElapsed(s64 start, s64 end) {
+    return static_cast<f32>(end - start) * 1e-9f;
+}
+
+s64
+PlatformGetWallClockFrequency() {
+    return 1000000000;
+}
+
+void
+PlatformSleep(f32 seconds) {
+    if (seconds > 0.0f) {
+        timespec duration;
+        duration.tv_sec = static_cast<time_t>(seconds);
+        duration.tv_nsec = static_cast<long>((seconds - duration.tv_sec) * 1e9f);
+        nanosleep(&duration, 0);
+    }
+}
+
+#endif // __linux__
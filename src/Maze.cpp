@@ -1,7 +1,7 @@
 #include "Maze.hpp"
 
 
-u8 maze[MAZE_HEIGHT][MAZE_WIDTH] = {
+static const u8 DEFAULT_MAZE[MAZE_HEIGHT][MAZE_WIDTH] = {
 // These numbers just help identify the cell easier
 //  1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8
     W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W,W, // 0
@@ -39,18 +39,36 @@ u8 maze[MAZE_HEIGHT][MAZE_WIDTH] = {
 
 
 void
-SetEmpty(Vector2Int cell) {
-    maze[cell.y][cell.x] = E;
+InitMaze(Maze *maze) {
+    maze->num_dots = 0;
+    for (s32 y = 0; y < MAZE_HEIGHT; ++y) {
+        for (s32 x = 0; x < MAZE_WIDTH; ++x) {
+            maze->cells[y][x] = DEFAULT_MAZE[y][x];
+            if (DEFAULT_MAZE[y][x] == d || DEFAULT_MAZE[y][x] == D) {
+                maze->num_dots += 1;
+            }
+        }
+    }
+}
+
+void
+SetEmpty(Maze *maze, Vector2Int cell) {
+    u8 *c = &maze->cells[cell.y][cell.x];
+    if (*c == d || *c == D) {
+        maze->num_dots -= 1;
+    }
+
+    *c = E;
 }
 
 bool
-IsCell(Vector2Int cell, u8 type) {
-    return maze[cell.y][cell.x] == type;
+IsCell(Maze *maze, Vector2Int cell, u8 type) {
+    return maze->cells[cell.y][cell.x] == type;
 }
 
 bool
-IsWall(Vector2Int cell) {
-    return maze[cell.y][cell.x] == W;
+IsWall(Maze *maze, Vector2Int cell) {
+    return maze->cells[cell.y][cell.x] == W;
 }
 
 bool
@@ -51,14 +51,26 @@ constexpr static u8 IS_INTERSECTION[MAZE_HEIGHT][MAZE_WIDTH] = {
 };
 
 
+// Every game has its own copy, since Pacman empties the cells he eats
+struct Maze {
+    u8 cells[MAZE_HEIGHT][MAZE_WIDTH];
+    u32 num_dots; // Small and big ones that are left
+};
+
+
+// Copies the stock layout
+void
+InitMaze(Maze *maze);
+
+// Eats the dot in the cell, if there is one
 void
-SetEmpty(Vector2Int cell);
+SetEmpty(Maze *maze, Vector2Int cell);
 
 bool
-IsCell(Vector2Int cell, u8 type);
+IsCell(Maze *maze, Vector2Int cell, u8 type);
 
 bool
-IsWall(Vector2Int cell);
+IsWall(Maze *maze, Vector2Int cell);
 
 bool
 IsIntersection(Vector2Int cell);
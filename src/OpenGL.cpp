@@ -2,36 +2,26 @@
 #include "Platform.hpp"
 
 
-#pragma pack(push, 1)
-struct BitmapFile {
-    u16 signature;
-    u32 file_size;
-    u16 reserved1;
-    u16 reserved2;
-    u32 pixels_offset;
-    u32 size;
-    s32 width;
-    s32 height;
-    u16 planes;
-    u16 bits_per_pixel;
-    u32 *pixels;
-};
-#pragma pack(pop)
 
 
+// Every instance is the unit quad moved and scaled by its translate and
+// scale. a_corner is -1 or 1 on each axis, and picks the matching edge of
+// the rectangle of the texture.
 static char *vertex_shader =
     "#version 330 core\n"
-    "layout (location = 0) in vec2 a_position;\n"
-    "layout (location = 1) in vec2 a_texcoord;\n"
+    "layout (location = 0) in vec2 a_corner;\n"
+    "layout (location = 1) in vec4 i_translate_scale;\n"
+    "layout (location = 2) in vec4 i_rect;\n"
     ""
     "out vec2 v_texcoord;\n"
     ""
-    "uniform mat4 model;\n"
     "uniform mat4 projection;\n"
     ""
     "void main() {\n"
-    "    gl_Position = projection * model * vec4(a_position, 0.0, 1.0);\n"
-    "    v_texcoord = a_texcoord;\n"
+    "    vec2 position = i_translate_scale.xy + a_corner * i_translate_scale.zw;\n"
+    "    vec2 t = a_corner * 0.5 + 0.5;\n"
+    "    gl_Position = projection * vec4(position, 0.0, 1.0);\n"
+    "    v_texcoord = vec2(mix(i_rect.x, i_rect.z, t.x), mix(i_rect.w, i_rect.y, t.y));\n"
     "}\n"
     "";
 
@@ -47,8 +37,28 @@ static char *fragment_shader =
     "";
 
 
-static u32 program_id;
+// What is bound right now. Everything that binds or deletes a program,
+// a vertex array or a texture has to go through the functions below, or
+// the cache no longer matches OpenGL. Only texture unit 0 is used.
+struct OpenGLState {
+    u32 program_id;
+    u32 vertex_array_id;
+    u32 texture_handle;
+    OpenGLStateStats stats;
+};
+
+static OpenGLState state;
+
 
+static bool
+AreStringsEqual(char *a, char *b) {
+    while (*a && *a == *b) {
+        ++a;
+        ++b;
+    }
+
+    return *a == *b;
+}
 
 static u32
 CreateAndCompileShader(char *shader_code, GLenum shader_type) {
@@ -65,48 +75,164 @@ CreateAndCompileShader(char *shader_code, GLenum shader_type) {
     return shader_id;
 }
 
-static void
-CreateOpenGLProgram() {
-    GLuint vertex_shader_id = CreateAndCompileShader(vertex_shader, GL_VERTEX_SHADER);
-    GLuint fragment_shader_id = CreateAndCompileShader(fragment_shader, GL_FRAGMENT_SHADER);
-    program_id = glCreateProgram();
-    glAttachShader(program_id, vertex_shader_id);
-    glAttachShader(program_id, fragment_shader_id);
-    glLinkProgram(program_id);
+static s32
+FindShaderVariable(ShaderVariable *variables, u32 num_variables, char *name) {
+    for (u32 i = 0; i < num_variables; ++i) {
+        if (AreStringsEqual(variables[i].name, name)) {
+            return variables[i].location;
+        }
+    }
+
+    return -1;
+}
+
+ShaderProgram
+CreateShaderProgram(char *vertex_shader_code, char *fragment_shader_code) {
+    GLuint vertex_shader_id = CreateAndCompileShader(vertex_shader_code, GL_VERTEX_SHADER);
+    GLuint fragment_shader_id = CreateAndCompileShader(fragment_shader_code, GL_FRAGMENT_SHADER);
+
+    ShaderProgram program = {};
+    program.id = glCreateProgram();
+    glAttachShader(program.id, vertex_shader_id);
+    glAttachShader(program.id, fragment_shader_id);
+    glLinkProgram(program.id);
 
     GLint is_linked = false;
-    glGetProgramiv(program_id, GL_LINK_STATUS, &is_linked);
+    glGetProgramiv(program.id, GL_LINK_STATUS, &is_linked);
     if (!is_linked) {
         PlatformShowErrorAndExit("Could not link shader program");
     }
 
     glDeleteShader(vertex_shader_id);
     glDeleteShader(fragment_shader_id);
+
+    // Look up every location once, so that setting a
+    // uniform by name never has to ask the driver
+    GLint num_uniforms = 0;
+    glGetProgramiv(program.id, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    ASSERT(static_cast<u32>(num_uniforms) <= MAX_SHADER_VARIABLES);
+    for (GLint i = 0; i < num_uniforms; ++i) {
+        ShaderVariable *uniform = &program.uniforms[program.num_uniforms];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program.id, i, MAX_SHADER_VARIABLE_NAME, 0, &size, &type, uniform->name);
+        uniform->location = glGetUniformLocation(program.id, uniform->name);
+        program.num_uniforms += 1;
+    }
+
+    GLint num_attributes = 0;
+    glGetProgramiv(program.id, GL_ACTIVE_ATTRIBUTES, &num_attributes);
+    ASSERT(static_cast<u32>(num_attributes) <= MAX_SHADER_VARIABLES);
+    for (GLint i = 0; i < num_attributes; ++i) {
+        ShaderVariable *attribute = &program.attributes[program.num_attributes];
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(program.id, i, MAX_SHADER_VARIABLE_NAME, 0, &size, &type, attribute->name);
+        attribute->location = glGetAttribLocation(program.id, attribute->name);
+        program.num_attributes += 1;
+    }
+
+    return program;
+}
+
+s32
+GetUniformLocation(ShaderProgram *program, char *name) {
+    return FindShaderVariable(program->uniforms, program->num_uniforms, name);
+}
+
+s32
+GetAttributeLocation(ShaderProgram *program, char *name) {
+    return FindShaderVariable(program->attributes, program->num_attributes, name);
+}
+
+void
+UseShaderProgram(ShaderProgram *program) {
+    state.stats.num_calls += 1;
+    if (state.program_id == program->id) {
+        state.stats.num_elided_calls += 1;
+        return;
+    }
+
+    glUseProgram(program->id);
+    state.program_id = program->id;
+}
+
+void
+BindVertexArray(u32 vertex_array_id) {
+    state.stats.num_calls += 1;
+    if (state.vertex_array_id == vertex_array_id) {
+        state.stats.num_elided_calls += 1;
+        return;
+    }
+
+    glBindVertexArray(vertex_array_id);
+    state.vertex_array_id = vertex_array_id;
+}
+
+void
+BindTexture2D(u32 texture_handle) {
+    state.stats.num_calls += 1;
+    if (state.texture_handle == texture_handle) {
+        state.stats.num_elided_calls += 1;
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture_handle);
+    state.texture_handle = texture_handle;
+}
+
+// OpenGL unbinds a deleted object and may hand its name out again, so
+// the cache forgets it too. Otherwise binding the new object that gets
+// the name would be skipped.
+void
+DeleteShaderProgram(ShaderProgram *program) {
+    if (state.program_id == program->id) {
+        state.program_id = 0;
+    }
+
+    glDeleteProgram(program->id);
+    program->id = 0;
+}
+
+void
+DeleteVertexArray(u32 vertex_array_id) {
+    if (state.vertex_array_id == vertex_array_id) {
+        state.vertex_array_id = 0;
+    }
+
+    glDeleteVertexArrays(1, &vertex_array_id);
+}
+
+void
+DeleteTexture2D(Texture2D *texture) {
+    if (state.texture_handle == texture->handle) {
+        state.texture_handle = 0;
+    }
+
+    glDeleteTextures(1, &texture->handle);
+    texture->handle = 0;
+}
+
+OpenGLStateStats
+GetOpenGLStateStats() {
+    return state.stats;
 }
 
 void
 OpenGLInit() {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    CreateOpenGLProgram();
-    glUseProgram(program_id);
+    state = {};
 }
 
 Texture2D
-LoadAndBindTexture(char *file_name) {
-    File file = PlatformReadFile(file_name);
-    void *buffer = file.buffer;
-    BitmapFile *bmp = static_cast<BitmapFile *>(buffer);
-    u8 *pixels = static_cast<u8 *>(buffer) + bmp->pixels_offset;
-    bmp->pixels = reinterpret_cast<u32 *>(pixels);
-
+MakeTexture(Bitmap *bitmap) {
     u32 texture_handle;
     glGenTextures(1, &texture_handle);
-    glBindTexture(GL_TEXTURE_2D, texture_handle);
+    BindTexture2D(texture_handle);
     glTexImage2D(
-        GL_TEXTURE_2D, 0, GL_RGBA, bmp->width, bmp->height,
-        0, GL_BGRA, GL_UNSIGNED_BYTE, bmp->pixels
+        GL_TEXTURE_2D, 0, GL_RGBA, bitmap->width, bitmap->height,
+        0, GL_BGRA, GL_UNSIGNED_BYTE, bitmap->pixels
     );
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -116,62 +242,453 @@ LoadAndBindTexture(char *file_name) {
 
     Texture2D texture;
     texture.handle = texture_handle;
-    texture.width = bmp->width;
-    texture.height = bmp->height;
-    PlatformFreeFile(file);
+    texture.width = bitmap->width;
+    texture.height = bitmap->height;
     return texture;
 }
 
 void
-SetMatrix4Uniform(char *name, Matrix4 m) {
-    u32 location = glGetUniformLocation(program_id, name);
+SetMatrix4Uniform(ShaderProgram *program, char *name, Matrix4 m) {
+    s32 location = GetUniformLocation(program, name);
+    ASSERT(location != -1);
+    UseShaderProgram(program);
     glUniformMatrix4fv(location, 1, GL_TRUE, m.data[0]);
 }
 
-VertexArray
-MakeVertexArray(Texture2D texture, RectangleInt rect) {
-    VertexArray vertex_array;
+u32
+GetBoundFramebuffer() {
+    GLint framebuffer_id = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer_id);
+    return static_cast<u32>(framebuffer_id);
+}
+
+void
+BindFramebuffer(u32 framebuffer_id) {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id);
+}
+
+RenderTarget
+MakeRenderTarget(s32 width, s32 height) {
+    RenderTarget target;
+    target.texture.width = width;
+    target.texture.height = height;
+    glGenTextures(1, &target.texture.handle);
+    BindTexture2D(target.texture.handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    u32 previous_framebuffer_id = GetBoundFramebuffer();
+    glGenFramebuffers(1, &target.framebuffer_id);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer_id);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture.handle, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        PlatformShowErrorAndExit("Could not create framebuffer");
+    }
+
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer_id);
+    return target;
+}
+
+void
+BlitRenderTarget(RenderTarget *source, u32 framebuffer_id) {
+    s32 width = source->texture.width;
+    s32 height = source->texture.height;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source->framebuffer_id);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_id);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id);
+}
+
+static void
+CreateStreamBufferStorage(StreamBuffer *buffer) {
+    glGenBuffers(1, &buffer->buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer_id);
+    if (GLAD_GL_VERSION_4_4) {
+        u64 size = STREAM_BUFFER_REGIONS * buffer->region_size;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, 0, flags);
+        buffer->mapped = static_cast<u8 *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+        ASSERT(buffer->mapped);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, buffer->region_size, 0, GL_STREAM_DRAW);
+        buffer->mapped = 0;
+    }
+}
+
+void
+InitStreamBuffer(StreamBuffer *buffer, u64 region_size) {
+    ASSERT(region_size > 0);
+    *buffer = {};
+    buffer->region_size = region_size;
+    CreateStreamBufferStorage(buffer);
+}
+
+static void
+WaitForStreamBufferRegion(StreamBuffer *buffer, u32 region) {
+    GLsync fence = buffer->fences[region];
+    if (!fence) {
+        return;
+    }
 
-    glGenVertexArrays(1, &vertex_array.id);
-    glBindVertexArray(vertex_array.id);
+    // Only the first wait has to flush the fence to the GPU
+    s64 wait_start = PlatformGetWallClock();
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    GLenum result;
+    do {
+        result = glClientWaitSync(fence, flags, 1000000);
+        flags = 0;
+    } while (result == GL_TIMEOUT_EXPIRED);
+    ASSERT(result != GL_WAIT_FAILED);
+    buffer->last_fence_wait_seconds += PlatformGetSecondsElapsed(wait_start, PlatformGetWallClock());
 
-    glGenBuffers(1, &vertex_array.vertex_buffer_id);
-    UpdateVertexBuffer(vertex_array.vertex_buffer_id, texture, rect);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(f32), 0);
-    glEnableVertexAttribArray(0);
+    glDeleteSync(fence);
+    buffer->fences[region] = 0;
+}
+
+void
+BeginStreamBufferFrame(StreamBuffer *buffer) {
+    buffer->last_fence_wait_seconds = 0.0f;
+    buffer->region_used = 0;
+    if (buffer->mapped) {
+        buffer->region = (buffer->region + 1) % STREAM_BUFFER_REGIONS;
+        WaitForStreamBufferRegion(buffer, buffer->region);
+    }
+}
 
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(f32), (void *) (2 * sizeof(f32)));
-    glEnableVertexAttribArray(1);
+u64
+WriteStreamBuffer(StreamBuffer *buffer, void *data, u64 size) {
+    if (buffer->region_used + size > buffer->region_size) {
+        // OpenGL keeps the old buffer alive until the GPU is done with it,
+        // so the draws of this frame that were already made are not lost
+        for (u32 i = 0; i < STREAM_BUFFER_REGIONS; ++i) {
+            if (buffer->fences[i]) {
+                glDeleteSync(buffer->fences[i]);
+                buffer->fences[i] = 0;
+            }
+        }
+
+        glDeleteBuffers(1, &buffer->buffer_id);
+        while (buffer->region_size < buffer->region_used + size) {
+            buffer->region_size *= 2;
+        }
+
+        CreateStreamBufferStorage(buffer);
+        buffer->region_used = 0;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer_id);
+    if (!buffer->mapped) {
+        // Orphan the old storage, so the driver does not wait until
+        // the GPU has drawn from it before it takes the new data
+        glBufferData(GL_ARRAY_BUFFER, buffer->region_size, 0, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+        return 0;
+    }
+
+    u64 offset = buffer->region * buffer->region_size + buffer->region_used;
+    u8 *destination = buffer->mapped + offset;
+    u8 *source = static_cast<u8 *>(data);
+    for (u64 i = 0; i < size; ++i) {
+        destination[i] = source[i];
+    }
+
+    buffer->region_used += size;
+    return offset;
+}
+
+void
+EndStreamBufferFrame(StreamBuffer *buffer) {
+    if (!buffer->mapped) {
+        return;
+    }
+
+    ASSERT(!buffer->fences[buffer->region]);
+    buffer->fences[buffer->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void
+InitSpriteBatch(SpriteBatch *batch, u32 instance_capacity) {
+    ASSERT(instance_capacity > 0);
+    *batch = {};
+    batch->program = CreateShaderProgram(vertex_shader, fragment_shader);
+    s32 corner_location = GetAttributeLocation(&batch->program, "a_corner");
+    batch->translate_scale_location = GetAttributeLocation(&batch->program, "i_translate_scale");
+    batch->rect_location = GetAttributeLocation(&batch->program, "i_rect");
+    ASSERT(corner_location != -1 && batch->translate_scale_location != -1 && batch->rect_location != -1);
+
+    glGenVertexArrays(1, &batch->vertex_array_id);
+    BindVertexArray(batch->vertex_array_id);
+
+    f32 corners[] = {
+        -1.0f,  1.0f,
+         1.0f,  1.0f,
+        -1.0f, -1.0f,
+         1.0f, -1.0f
+    };
+
+    glGenBuffers(1, &batch->quad_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->quad_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(corner_location, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(f32), 0);
+    glEnableVertexAttribArray(corner_location);
 
     u32 indices[] = {
         0, 1, 2,
         1, 2, 3
     };
 
-    u32 element_buffer;
-    glGenBuffers(1, &element_buffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+    glGenBuffers(1, &batch->element_buffer_id);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->element_buffer_id);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-    glBindVertexArray(0);
-    glDeleteBuffers(1, &element_buffer);
-    return vertex_array;
+    // The attribute pointers are set for every draw, see FlushSpriteBatch
+    InitStreamBuffer(&batch->instance_stream, instance_capacity * sizeof(SpriteInstance));
+    glEnableVertexAttribArray(batch->translate_scale_location);
+    glVertexAttribDivisor(batch->translate_scale_location, 1);
+    glEnableVertexAttribArray(batch->rect_location);
+    glVertexAttribDivisor(batch->rect_location, 1);
+
+    batch->instances = static_cast<SpriteInstance *>(PlatformAllocateMemory(instance_capacity * sizeof(SpriteInstance)));
+    batch->instance_capacity = instance_capacity;
+}
+
+void
+BeginSpriteBatch(SpriteBatch *batch) {
+    batch->num_instances = 0;
+    batch->num_draws = 0;
+    batch->num_draw_calls = 0;
+}
+
+static void
+FlushSpriteBatch(SpriteBatch *batch) {
+    if (batch->num_instances == 0) {
+        return;
+    }
+
+    StreamBuffer *stream = &batch->instance_stream;
+    u64 offset = WriteStreamBuffer(stream, batch->instances, batch->num_instances * sizeof(SpriteInstance));
+
+    // GL 3.3 has no base instance, so a draw that does not start at the
+    // first instance points the attributes at its own instances instead
+    UseShaderProgram(&batch->program);
+    BindVertexArray(batch->vertex_array_id);
+    for (u32 i = 0; i < batch->num_draws; ++i) {
+        SpriteBatchDraw *draw = &batch->draws[i];
+        u8 *first_instance = 0;
+        first_instance += offset + draw->first_instance * sizeof(SpriteInstance);
+        glVertexAttribPointer(batch->translate_scale_location, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), first_instance);
+        glVertexAttribPointer(batch->rect_location, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), first_instance + 4 * sizeof(f32));
+
+        BindTexture2D(draw->texture_handle);
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, draw->num_instances);
+        batch->num_draw_calls += 1;
+    }
+
+    batch->num_instances = 0;
+    batch->num_draws = 0;
 }
 
 void
-UpdateVertexBuffer(u32 vertex_buffer_id, Texture2D texture, RectangleInt rect) {
-    f32 x1 = static_cast<f32>(rect.left) / texture.width;
-    f32 y1 = 1.0f - (static_cast<f32>(rect.top) / texture.height);
-    f32 x2 = x1 + (static_cast<f32>(rect.width) / texture.width);
-    f32 y2 = y1 - (static_cast<f32>(rect.height) / texture.height);
+PushSpriteInstance(SpriteBatch *batch, Texture2D texture, SpriteInstance *instance) {
+    SpriteBatchDraw *draw = (batch->num_draws > 0) ? &batch->draws[batch->num_draws - 1] : 0;
+    if (!draw || draw->texture_handle != texture.handle) {
+        // Only happens with more textures than draws, and
+        // it costs an upload, but the order is preserved
+        if (batch->num_draws == MAX_SPRITE_BATCH_DRAWS) {
+            FlushSpriteBatch(batch);
+        }
 
-    f32 vertices[] = {
-        -1.0f,  1.0f, x1, y1,
-         1.0f,  1.0f, x2, y1,
-        -1.0f, -1.0f, x1, y2,
-         1.0f, -1.0f, x2, y2
-    };
+        draw = &batch->draws[batch->num_draws];
+        draw->texture_handle = texture.handle;
+        draw->first_instance = batch->num_instances;
+        draw->num_instances = 0;
+        batch->num_draws += 1;
+    }
+
+    if (batch->num_instances == batch->instance_capacity) {
+        u32 new_capacity = batch->instance_capacity * 2;
+        SpriteInstance *new_instances = static_cast<SpriteInstance *>(PlatformAllocateMemory(new_capacity * sizeof(SpriteInstance)));
+        for (u32 i = 0; i < batch->num_instances; ++i) {
+            new_instances[i] = batch->instances[i];
+        }
+
+        PlatformFreeMemory(batch->instances);
+        batch->instances = new_instances;
+        batch->instance_capacity = new_capacity;
+    }
+
+    batch->instances[batch->num_instances] = *instance;
+    batch->num_instances += 1;
+    draw->num_instances += 1;
+}
+
+void
+EndSpriteBatch(SpriteBatch *batch) {
+    FlushSpriteBatch(batch);
+}
+
+void
+InitGpuTimer(GpuTimer *timer) {
+    *timer = {};
+    timer->is_supported = GLAD_GL_VERSION_3_3 != 0;
+    if (timer->is_supported) {
+        glGenQueries(GPU_TIMER_FRAMES * GPU_TIMESTAMP_COUNT, &timer->query_ids[0][0]);
+    }
+}
+
+static f32
+GetGpuSeconds(u64 start, u64 end) {
+    return static_cast<f32>(end - start) * 1e-9f;
+}
+
+// The timestamps of a frame are recorded in order, so when the last one
+// is available, so are the others
+static void
+ReadGpuTimer(GpuTimer *timer) {
+    while (timer->num_pending > 0) {
+        u32 *query_ids = timer->query_ids[timer->first_pending];
+        s32 is_available = 0;
+        glGetQueryObjectiv(query_ids[GPU_TIMESTAMP_FRAME_END], GL_QUERY_RESULT_AVAILABLE, &is_available);
+        if (!is_available) {
+            break;
+        }
+
+        GLuint64 timestamps[GPU_TIMESTAMP_COUNT];
+        for (u32 i = 0; i < GPU_TIMESTAMP_COUNT; ++i) {
+            glGetQueryObjectui64v(query_ids[i], GL_QUERY_RESULT, &timestamps[i]);
+        }
+
+        u64 frame = timer->frames[timer->first_pending];
+        RenderStats *stats = &timer->stats;
+        stats->frame_seconds = 0.0f;
+        if (stats->frame > 0 && stats->frame + 1 == frame) {
+            stats->frame_seconds = GetGpuSeconds(timer->last_frame_start, timestamps[GPU_TIMESTAMP_FRAME_START]);
+        }
+
+        stats->frame = frame;
+        stats->static_layer_seconds = GetGpuSeconds(timestamps[GPU_TIMESTAMP_FRAME_START], timestamps[GPU_TIMESTAMP_SCREEN_START]);
+        stats->screen_seconds = GetGpuSeconds(timestamps[GPU_TIMESTAMP_SCREEN_START], timestamps[GPU_TIMESTAMP_FRAME_END]);
+        timer->last_frame_start = timestamps[GPU_TIMESTAMP_FRAME_START];
+
+        timer->first_pending = (timer->first_pending + 1) % GPU_TIMER_FRAMES;
+        timer->num_pending -= 1;
+    }
+}
+
+void
+BeginGpuTimerFrame(GpuTimer *timer, u64 frame) {
+    timer->is_measuring = false;
+    if (!timer->is_supported) {
+        return;
+    }
+
+    ReadGpuTimer(timer);
+    if (timer->num_pending < GPU_TIMER_FRAMES) {
+        timer->is_measuring = true;
+        timer->frames[(timer->first_pending + timer->num_pending) % GPU_TIMER_FRAMES] = frame;
+        RecordGpuTimestamp(timer, GPU_TIMESTAMP_FRAME_START);
+    }
+}
+
+void
+RecordGpuTimestamp(GpuTimer *timer, u32 timestamp) {
+    if (timer->is_measuring) {
+        u32 slot = (timer->first_pending + timer->num_pending) % GPU_TIMER_FRAMES;
+        glQueryCounter(timer->query_ids[slot][timestamp], GL_TIMESTAMP);
+    }
+}
+
+void
+EndGpuTimerFrame(GpuTimer *timer) {
+    if (timer->is_measuring) {
+        RecordGpuTimestamp(timer, GPU_TIMESTAMP_FRAME_END);
+        timer->num_pending += 1;
+        timer->is_measuring = false;
+    }
+}
+
+static void
+ExecuteOpenGLRenderCommands(RenderBackend *backend, RenderCommandList *list) {
+    OpenGLRenderer *renderer = static_cast<OpenGLRenderer *>(backend->data);
+    ASSERT(list->size == renderer->size);
+    if (list->sprite_sheet != renderer->sprite_sheet) {
+        if (renderer->sprite_sheet) {
+            DeleteTexture2D(&renderer->sprite_sheet_texture);
+        }
+
+        renderer->sprite_sheet_texture = MakeTexture(list->sprite_sheet);
+        renderer->sprite_sheet = list->sprite_sheet;
+    }
+
+    // The static layer is repaired before anything is drawn on the screen
+    renderer->num_frames += 1;
+    BeginGpuTimerFrame(&renderer->timer, renderer->num_frames);
+    BeginStreamBufferFrame(&renderer->batch.instance_stream);
+    bool is_screen_started = false;
+
+    glEnable(GL_SCISSOR_TEST);
+    for (u32 i = 0; i < list->num_commands; ++i) {
+        RenderCommand *command = &list->commands[i];
+        if (command->target == RENDER_TARGET_SCREEN && !is_screen_started) {
+            RecordGpuTimestamp(&renderer->timer, GPU_TIMESTAMP_SCREEN_START);
+            is_screen_started = true;
+        }
+
+        u32 framebuffer_id = renderer->framebuffer_ids[command->target];
+        glScissor(command->clip.left, command->clip.top, command->clip.width, command->clip.height);
+        switch (command->type) {
+            case RENDER_COMMAND_CLEAR: {
+                BindFramebuffer(framebuffer_id);
+                glClear(GL_COLOR_BUFFER_BIT);
+            } break;
+            case RENDER_COMMAND_DRAW_SPRITES: {
+                BindFramebuffer(framebuffer_id);
+                BeginSpriteBatch(&renderer->batch);
+                for (u32 j = 0; j < command->num_sprites; ++j) {
+                    SpriteInstance *sprite = &list->sprites[command->first_sprite + j];
+                    PushSpriteInstance(&renderer->batch, renderer->sprite_sheet_texture, sprite);
+                }
+
+                EndSpriteBatch(&renderer->batch);
+            } break;
+            case RENDER_COMMAND_COPY_STATIC_LAYER: {
+                BlitRenderTarget(&renderer->static_layer, framebuffer_id);
+            } break;
+        }
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+    BindFramebuffer(renderer->framebuffer_ids[RENDER_TARGET_SCREEN]);
+
+    if (!is_screen_started) {
+        RecordGpuTimestamp(&renderer->timer, GPU_TIMESTAMP_SCREEN_START);
+    }
+
+    EndStreamBufferFrame(&renderer->batch.instance_stream);
+    EndGpuTimerFrame(&renderer->timer);
+    list->stats = renderer->timer.stats;
+}
+
+RenderBackend
+InitOpenGLRenderer(OpenGLRenderer *renderer, Vector2Int size) {
+    OpenGLInit();
+    *renderer = {};
+    renderer->size = size;
+    InitSpriteBatch(&renderer->batch, DEFAULT_SPRITE_BATCH_CAPACITY);
+    f32 w = static_cast<f32>(size.x);
+    f32 h = static_cast<f32>(size.y);
+    SetMatrix4Uniform(&renderer->batch.program, "projection", Orthographic(0.0f, w, 0.0f, h));
+
+    renderer->static_layer = MakeRenderTarget(size.x, size.y);
+    renderer->framebuffer_ids[RENDER_TARGET_SCREEN] = GetBoundFramebuffer();
+    renderer->framebuffer_ids[RENDER_TARGET_STATIC_LAYER] = renderer->static_layer.framebuffer_id;
+    InitGpuTimer(&renderer->timer);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    RenderBackend backend;
+    backend.execute = ExecuteOpenGLRenderCommands;
+    backend.data = renderer;
+    return backend;
 }
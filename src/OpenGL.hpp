@@ -1,8 +1,9 @@
 #ifndef PACMAN_OPENGL_HPP
 #define PACMAN_OPENGL_HPP
 #include "Common.hpp"
-#include "glad\glad.h"
+#include "glad/glad.h"
 #include "Math.hpp"
+#include "Renderer.hpp"
 
 
 struct Texture2D {
@@ -11,24 +12,234 @@ struct Texture2D {
     s32 height;
 };
 
-struct VertexArray {
+constexpr u32 MAX_SHADER_VARIABLES = 16;
+constexpr u32 MAX_SHADER_VARIABLE_NAME = 32;
+
+struct ShaderVariable {
+    char name[MAX_SHADER_VARIABLE_NAME];
+    s32 location;
+};
+
+// The locations of the active uniforms and attributes
+// are looked up once, when the program is linked
+struct ShaderProgram {
     u32 id;
-    u32 vertex_buffer_id; // For vertices
+    ShaderVariable uniforms[MAX_SHADER_VARIABLES];
+    u32 num_uniforms;
+    ShaderVariable attributes[MAX_SHADER_VARIABLES];
+    u32 num_attributes;
+};
+
+// Counts the binds that went through the state cache since OpenGLInit.
+// A call is elided when the object is already bound.
+struct OpenGLStateStats {
+    u64 num_calls;
+    u64 num_elided_calls;
+};
+
+// A texture that can be drawn into
+struct RenderTarget {
+    u32 framebuffer_id;
+    Texture2D texture;
+};
+
+constexpr u32 STREAM_BUFFER_REGIONS = 3;
+
+// A vertex buffer for data that is rewritten every frame. With GL 4.4
+// the buffer is mapped once, and every frame writes its own region, one
+// write after the other, while the GPU may still read the regions of the
+// two frames before it. A fence per region makes the CPU wait only when
+// it gets a whole ring of frames ahead. Without GL 4.4 the buffer is
+// orphaned on every write instead.
+struct StreamBuffer {
+    u32 buffer_id;
+    u64 region_size;
+    u32 region; // Of the current frame
+    u64 region_used; // By the writes of the current frame
+    u8 *mapped; // 0 when the buffer is orphaned
+    GLsync fences[STREAM_BUFFER_REGIONS];
+    f32 last_fence_wait_seconds; // Spent in the last BeginStreamBufferFrame, for profiling
+};
+
+// Consecutive instances with the same texture are drawn with one call
+struct SpriteBatchDraw {
+    u32 texture_handle;
+    u32 first_instance;
+    u32 num_instances;
+};
+
+constexpr u32 MAX_SPRITE_BATCH_DRAWS = 64;
+constexpr u32 DEFAULT_SPRITE_BATCH_CAPACITY = 256;
+
+// Collects the sprites of a frame in one instance stream. EndSpriteBatch
+// uploads the stream once and makes one instanced draw call per texture
+// run, so the number of draw calls does not depend on the number of
+// sprites. Every sprite is the same unit quad, expanded by the vertex
+// shader.
+struct SpriteBatch {
+    ShaderProgram program;
+    s32 translate_scale_location;
+    s32 rect_location;
+
+    u32 vertex_array_id;
+    u32 quad_buffer_id;
+    u32 element_buffer_id;
+    StreamBuffer instance_stream;
+
+    SpriteInstance *instances;
+    u32 num_instances;
+    u32 instance_capacity;
+
+    SpriteBatchDraw draws[MAX_SPRITE_BATCH_DRAWS];
+    u32 num_draws;
+    u32 num_draw_calls; // Made during the last batch, for profiling
+};
+
+constexpr u32 GPU_TIMER_FRAMES = 4;
+
+enum {
+    GPU_TIMESTAMP_FRAME_START,
+    GPU_TIMESTAMP_SCREEN_START,
+    GPU_TIMESTAMP_FRAME_END,
+
+    GPU_TIMESTAMP_COUNT
+};
+
+// GL_TIMESTAMP queries of the last GPU_TIMER_FRAMES frames. A result is
+// only read once it is available, so measuring never waits for the GPU.
+// When the queries of every frame in the ring are still in flight, the
+// frame is not measured.
+struct GpuTimer {
+    u32 query_ids[GPU_TIMER_FRAMES][GPU_TIMESTAMP_COUNT];
+    u64 frames[GPU_TIMER_FRAMES]; // The frame each set of queries measures
+    u32 first_pending;
+    u32 num_pending;
+    bool is_supported; // Timestamps need GL 3.3
+    bool is_measuring; // Whether the current frame has queries
+    u64 last_frame_start; // GPU_TIMESTAMP_FRAME_START of stats.frame, in nanoseconds
+    RenderStats stats; // The last frame that was read back
+};
+
+// The RenderBackend that draws with OpenGL. The screen is the framebuffer
+// that is bound when the renderer is initialized.
+struct OpenGLRenderer {
+    SpriteBatch batch;
+    Bitmap *sprite_sheet; // What sprite_sheet_texture was made from
+    Texture2D sprite_sheet_texture;
+    Vector2Int size;
+    u32 framebuffer_ids[RENDER_TARGET_COUNT];
+    RenderTarget static_layer;
+    GpuTimer timer;
+    u64 num_frames;
 };
 
 void
 OpenGLInit();
 
 Texture2D
-LoadAndBindTexture(char *file_name);
+MakeTexture(Bitmap *bitmap);
+
+ShaderProgram
+CreateShaderProgram(char *vertex_shader_code, char *fragment_shader_code);
+
+// Returns -1 if the program has no active variable with that name
+s32
+GetUniformLocation(ShaderProgram *program, char *name);
+
+s32
+GetAttributeLocation(ShaderProgram *program, char *name);
+
+// Binds through the state cache, which skips the call
+// if the program, vertex array or texture is already bound
+void
+UseShaderProgram(ShaderProgram *program);
 
 void
-SetMatrix4Uniform(char *name, Matrix4 m);
+BindVertexArray(u32 vertex_array_id);
 
-VertexArray
-MakeVertexArray(Texture2D texture, RectangleInt rect);
+void
+BindTexture2D(u32 texture_handle);
+
+// Delete through these, so the state cache does not keep the name
+void
+DeleteShaderProgram(ShaderProgram *program);
 
 void
-UpdateVertexBuffer(u32 vertex_buffer_id, Texture2D texture, RectangleInt rect);
+DeleteVertexArray(u32 vertex_array_id);
+
+void
+DeleteTexture2D(Texture2D *texture);
+
+OpenGLStateStats
+GetOpenGLStateStats();
+
+void
+SetMatrix4Uniform(ShaderProgram *program, char *name, Matrix4 m);
+
+// The framebuffer that is bound right now, e.g., to find out what
+// the window system expects to be drawn into
+u32
+GetBoundFramebuffer();
+
+void
+BindFramebuffer(u32 framebuffer_id);
+
+// Creates a transparent RGBA target
+RenderTarget
+MakeRenderTarget(s32 width, s32 height);
+
+// Copies all of source to the bottom left corner of the framebuffer
+// and leaves the framebuffer bound
+void
+BlitRenderTarget(RenderTarget *source, u32 framebuffer_id);
+
+void
+InitStreamBuffer(StreamBuffer *buffer, u64 region_size);
+
+// Moves on to the next region, and waits until the GPU is done with it
+void
+BeginStreamBufferFrame(StreamBuffer *buffer);
+
+// Copies the data after the writes before it in this frame and returns
+// its offset in the buffer, which is left bound to GL_ARRAY_BUFFER. Grows
+// the regions if the data of the frame does not fit.
+u64
+WriteStreamBuffer(StreamBuffer *buffer, void *data, u64 size);
+
+// Has to follow the draws that read the writes of the frame
+void
+EndStreamBufferFrame(StreamBuffer *buffer);
+
+void
+InitSpriteBatch(SpriteBatch *batch, u32 instance_capacity);
+
+void
+BeginSpriteBatch(SpriteBatch *batch);
+
+// Instances are drawn in the order they are pushed
+void
+PushSpriteInstance(SpriteBatch *batch, Texture2D texture, SpriteInstance *instance);
+
+void
+EndSpriteBatch(SpriteBatch *batch);
+
+void
+InitGpuTimer(GpuTimer *timer);
+
+// Reads back the results that are available, then starts measuring
+// frame if there is room in the ring
+void
+BeginGpuTimerFrame(GpuTimer *timer, u64 frame);
+
+// Records the GPU time at which the commands so far are done
+void
+RecordGpuTimestamp(GpuTimer *timer, u32 timestamp);
+
+void
+EndGpuTimerFrame(GpuTimer *timer);
+
+// Also calls OpenGLInit
+RenderBackend
+InitOpenGLRenderer(OpenGLRenderer *renderer, Vector2Int size);
 
 #endif // PACMAN_OPENGL_HPP
@@ -19,8 +19,10 @@ struct Input {
     bool is_key_down[KEY_COUNT];
 };
 
+// The buffer may be read-only
 struct File {
     void *buffer;
+    u64 size;
 };
 
 
@@ -30,7 +32,56 @@ PlatformReadFile(char *file_name);
 void
 PlatformFreeFile(File file);
 
+// Returns zeroed memory that starts on a page boundary
+void *
+PlatformAllocateMemory(u64 size);
+
+void
+PlatformFreeMemory(void *memory);
+
 void
 PlatformShowErrorAndExit(char *msg);
 
+// Threads run until the process exits
+typedef void PlatformThreadFunction(void *data);
+
+void
+PlatformStartThread(PlatformThreadFunction *function, void *data);
+
+// Logical processors, including the one of the calling thread
+u32
+PlatformGetProcessorCount();
+
+// Whether the CPU and the OS support AVX2, see PACMAN_AVX2
+bool
+PlatformHasAvx2();
+
+void *
+PlatformCreateSemaphore(u32 initial_count);
+
+void
+PlatformSignalSemaphore(void *semaphore, u32 count);
+
+void
+PlatformWaitSemaphore(void *semaphore);
+
+// Takes one from the count if it is not 0, without waiting
+bool
+PlatformTryWaitSemaphore(void *semaphore);
+
+// A high resolution timestamp, only meaningful relative to another one
+s64
+PlatformGetWallClock();
+
+f32
+PlatformGetSecondsElapsed(s64 start, s64 end);
+
+// Wall clock ticks per second
+s64
+PlatformGetWallClockFrequency();
+
+// May sleep longer, by up to a tick of the scheduler
+void
+PlatformSleep(f32 seconds);
+
 #endif // PACMAN_PLATFORM_HPP
@@ -0,0 +1,309 @@
+#include "RenderSystem.hpp"
+#include "Platform.hpp"
+
+
+static bool
+IsStaticMask(u32 mask) {
+    return !(mask & (MASK_ANIMATION | MASK_MOTION));
+}
+
+static s32
+Floor(f32 a) {
+    s32 result = static_cast<s32>(a);
+    return (a < result) ? result - 1 : result;
+}
+
+// The pixels a sprite can touch, rounded outwards
+static RectangleInt
+GetPixelRect(SpriteInstance *instance) {
+    s32 left = Floor(instance->translate.x - instance->scale.x);
+    s32 bottom = Floor(instance->translate.y - instance->scale.y);
+    s32 right = Floor(instance->translate.x + instance->scale.x) + 1;
+    s32 top = Floor(instance->translate.y + instance->scale.y) + 1;
+
+    // RectangleInt::top is the bottom edge here, since y goes up in the render targets
+    RectangleInt rect = { left, bottom, right - left, top - bottom };
+    return rect;
+}
+
+static bool
+AreOverlapping(RectangleInt a, RectangleInt b) {
+    return a.left < b.left + b.width && b.left < a.left + a.width &&
+           a.top < b.top + b.height && b.top < a.top + a.height;
+}
+
+static bool
+AreEqual(SpriteInstance *a, SpriteInstance *b) {
+    return a->translate == b->translate &&
+           a->scale == b->scale &&
+           a->rect.left == b->rect.left &&
+           a->rect.top == b->rect.top &&
+           a->rect.right == b->rect.right &&
+           a->rect.bottom == b->rect.bottom;
+}
+
+// Clears the damaged rectangles of the static layer and draws the static
+// sprites that overlap them again. The clip keeps every other pixel, so
+// the result is the same as drawing the whole layer again.
+static void
+RepairStaticLayer(RenderSystem *system, RenderCommandList *commands, RectangleInt *damage, u32 num_damage) {
+    for (u32 i = 0; i < num_damage; ++i) {
+        PushRenderCommand(commands, RENDER_COMMAND_CLEAR, RENDER_TARGET_STATIC_LAYER, damage[i]);
+        PushRenderCommand(commands, RENDER_COMMAND_DRAW_SPRITES, RENDER_TARGET_STATIC_LAYER, damage[i]);
+        for (u32 j = 0; j < system->num_static_sprites; ++j) {
+            SpriteInstance *sprite = &system->static_sprites[j];
+            if (AreOverlapping(GetPixelRect(sprite), damage[i])) {
+                PushSprite(commands, sprite);
+            }
+        }
+    }
+}
+
+static SpriteInstance *
+GetChunkInstances(RenderSystem *system, Chunk *chunk) {
+    ASSERT(chunk->id < system->num_cached_chunks);
+    return &system->chunk_instances[chunk->id * CHUNK_CAPACITY];
+}
+
+// The World only ever adds chunks, so the cache grows with it. A new
+// chunk is drawn from rows that were just pushed, which marks it changed.
+static void
+GrowChunkInstances(World *world, RenderSystem *system) {
+    if (world->num_chunks <= system->num_cached_chunks) {
+        return;
+    }
+
+    u64 size = static_cast<u64>(world->num_chunks) * CHUNK_CAPACITY * sizeof(SpriteInstance);
+    SpriteInstance *new_instances = static_cast<SpriteInstance *>(PlatformAllocateMemory(size));
+    for (u32 i = 0; i < system->num_cached_chunks * CHUNK_CAPACITY; ++i) {
+        new_instances[i] = system->chunk_instances[i];
+    }
+
+    if (system->chunk_instances) {
+        PlatformFreeMemory(system->chunk_instances);
+    }
+
+    system->chunk_instances = new_instances;
+    system->num_cached_chunks = world->num_chunks;
+}
+
+// Compares the static sprites with the ones in the layer, row by row. When
+// a dot is eaten, the last dot of its archetype fills its row, so only
+// the rectangles of those two dots are redrawn.
+static void
+UpdateStaticLayer(World *world, RenderSystem *system, RenderCommandList *commands) {
+    constexpr u32 MASK = MASK_TRANSFORM | MASK_SPRITE;
+    bool is_changed = !system->is_static_layer_valid;
+    u32 num_sprites = 0;
+    for (Chunk *chunk = NextChunk(world, MASK, 0); chunk; chunk = NextChunk(world, MASK, chunk)) {
+        if (IsStaticMask(chunk->mask)) {
+            num_sprites += chunk->count;
+            is_changed |= HasChunkChanged(chunk, MASK, system->change_version);
+        }
+    }
+
+    if (!is_changed && num_sprites == system->num_static_sprites) {
+        return;
+    }
+
+    if (num_sprites > system->static_sprite_capacity) {
+        u32 new_capacity = (system->static_sprite_capacity > 0) ? system->static_sprite_capacity : 256;
+        while (new_capacity < num_sprites) {
+            new_capacity *= 2;
+        }
+
+        SpriteInstance *new_sprites = static_cast<SpriteInstance *>(PlatformAllocateMemory(new_capacity * sizeof(SpriteInstance)));
+        for (u32 i = 0; i < system->num_static_sprites; ++i) {
+            new_sprites[i] = system->static_sprites[i];
+        }
+
+        if (system->static_sprites) {
+            PlatformFreeMemory(system->static_sprites);
+            PlatformFreeMemory(system->next_static_sprites);
+        }
+
+        system->static_sprites = new_sprites;
+        system->next_static_sprites = static_cast<SpriteInstance *>(PlatformAllocateMemory(new_capacity * sizeof(SpriteInstance)));
+        system->static_sprite_capacity = new_capacity;
+    }
+
+    u32 num_next_sprites = 0;
+    for (Chunk *chunk = NextChunk(world, MASK, 0); chunk; chunk = NextChunk(world, MASK, chunk)) {
+        if (IsStaticMask(chunk->mask)) {
+            SpriteInstance *instances = GetChunkInstances(system, chunk);
+            for (u32 row = 0; row < chunk->count; ++row) {
+                system->next_static_sprites[num_next_sprites] = instances[row];
+                num_next_sprites += 1;
+            }
+        }
+    }
+
+    RectangleInt damage[MAX_STATIC_LAYER_DAMAGE];
+    u32 num_damage = 0;
+    bool is_full_redraw = !system->is_static_layer_valid;
+    u32 num_rows = (num_next_sprites > system->num_static_sprites) ? num_next_sprites : system->num_static_sprites;
+    for (u32 i = 0; i < num_rows && !is_full_redraw; ++i) {
+        SpriteInstance *old_sprite = (i < system->num_static_sprites) ? &system->static_sprites[i] : 0;
+        SpriteInstance *new_sprite = (i < num_next_sprites) ? &system->next_static_sprites[i] : 0;
+        if (old_sprite && new_sprite && AreEqual(old_sprite, new_sprite)) {
+            continue;
+        }
+
+        if (num_damage + 2 > MAX_STATIC_LAYER_DAMAGE) {
+            is_full_redraw = true;
+            break;
+        }
+
+        if (old_sprite) {
+            damage[num_damage++] = GetPixelRect(old_sprite);
+        }
+
+        if (new_sprite) {
+            damage[num_damage++] = GetPixelRect(new_sprite);
+        }
+    }
+
+    SpriteInstance *swap = system->static_sprites;
+    system->static_sprites = system->next_static_sprites;
+    system->next_static_sprites = swap;
+    system->num_static_sprites = num_next_sprites;
+
+    if (is_full_redraw) {
+        damage[0] = GetFullClip(commands);
+        num_damage = 1;
+    }
+
+    RepairStaticLayer(system, commands, damage, num_damage);
+    system->is_static_layer_valid = true;
+}
+
+void
+InitRenderSystem(RenderSystem *system, char *sprite_sheet_file_name) {
+    *system = {};
+    system->sprite_sheet = LoadBitmapFile(sprite_sheet_file_name);
+    Bitmap *sprite_sheet = &system->sprite_sheet;
+    system->sprite_rects[SPRITE_ID_BIG_DOT1]           = MakeTextureRect(sprite_sheet, { 233, 240, 8, 8 });
+    system->sprite_rects[SPRITE_ID_BIG_DOT2]           = MakeTextureRect(sprite_sheet, { 242, 240, 8, 8 });
+    system->sprite_rects[SPRITE_ID_PACMAN_RIGHT1]      = MakeTextureRect(sprite_sheet, { 229, 0, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_RIGHT2]      = MakeTextureRect(sprite_sheet, { 245, 0, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_RIGHT3]      = MakeTextureRect(sprite_sheet, { 261, 0, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_LEFT1]       = MakeTextureRect(sprite_sheet, { 229, 16, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_LEFT2]       = MakeTextureRect(sprite_sheet, { 245, 16, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_LEFT3]       = MakeTextureRect(sprite_sheet, { 261, 16, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_UP1]         = MakeTextureRect(sprite_sheet, { 229, 32, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_UP2]         = MakeTextureRect(sprite_sheet, { 245, 32, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_UP3]         = MakeTextureRect(sprite_sheet, { 261, 32, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DOWN1]       = MakeTextureRect(sprite_sheet, { 229, 48, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DOWN2]       = MakeTextureRect(sprite_sheet, { 245, 48, 15, 15 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DOWN3]       = MakeTextureRect(sprite_sheet, { 261, 48, 15, 15 });
+
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD1]       = MakeTextureRect(sprite_sheet, { 276, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD2]       = MakeTextureRect(sprite_sheet, { 292, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD3]       = MakeTextureRect(sprite_sheet, { 308, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD4]       = MakeTextureRect(sprite_sheet, { 324, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD5]       = MakeTextureRect(sprite_sheet, { 340, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD6]       = MakeTextureRect(sprite_sheet, { 356, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD7]       = MakeTextureRect(sprite_sheet, { 372, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD8]       = MakeTextureRect(sprite_sheet, { 388, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD9]       = MakeTextureRect(sprite_sheet, { 404, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD10]      = MakeTextureRect(sprite_sheet, { 420, 0, 17, 17 });
+    system->sprite_rects[SPRITE_ID_PACMAN_DEAD11]      = MakeTextureRect(sprite_sheet, { 436, 0, 17, 17 });
+
+    system->sprite_rects[SPRITE_ID_BLINKY_RIGHT1]      = MakeTextureRect(sprite_sheet, { 229, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_BLINKY_RIGHT2]      = MakeTextureRect(sprite_sheet, { 245, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_BLINKY_LEFT1]       = MakeTextureRect(sprite_sheet, { 261, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_BLINKY_LEFT2]       = MakeTextureRect(sprite_sheet, { 277, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_BLINKY_UP1]         = MakeTextureRect(sprite_sheet, { 293, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_BLINKY_UP2]         = MakeTextureRect(sprite_sheet, { 309, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_BLINKY_DOWN1]       = MakeTextureRect(sprite_sheet, { 325, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_BLINKY_DOWN2]       = MakeTextureRect(sprite_sheet, { 341, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_PINKY_RIGHT1]       = MakeTextureRect(sprite_sheet, { 229, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_PINKY_RIGHT2]       = MakeTextureRect(sprite_sheet, { 245, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_PINKY_LEFT1]        = MakeTextureRect(sprite_sheet, { 261, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_PINKY_LEFT2]        = MakeTextureRect(sprite_sheet, { 277, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_PINKY_UP1]          = MakeTextureRect(sprite_sheet, { 293, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_PINKY_UP2]          = MakeTextureRect(sprite_sheet, { 309, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_PINKY_DOWN1]        = MakeTextureRect(sprite_sheet, { 325, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_PINKY_DOWN2]        = MakeTextureRect(sprite_sheet, { 341, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_INKY_RIGHT1]        = MakeTextureRect(sprite_sheet, { 229, 96, 16, 16 });
+    system->sprite_rects[SPRITE_ID_INKY_RIGHT2]        = MakeTextureRect(sprite_sheet, { 245, 96, 16, 16 });
+    system->sprite_rects[SPRITE_ID_INKY_LEFT1]         = MakeTextureRect(sprite_sheet, { 261, 96, 16, 16 });
+    system->sprite_rects[SPRITE_ID_INKY_LEFT2]         = MakeTextureRect(sprite_sheet, { 277, 96, 16, 16 });
+    system->sprite_rects[SPRITE_ID_INKY_UP1]           = MakeTextureRect(sprite_sheet, { 293, 96, 16, 16 });
+    system->sprite_rects[SPRITE_ID_INKY_UP2]           = MakeTextureRect(sprite_sheet, { 309, 96, 16, 16 });
+    system->sprite_rects[SPRITE_ID_INKY_DOWN1]         = MakeTextureRect(sprite_sheet, { 325, 96, 16, 16 });
+    system->sprite_rects[SPRITE_ID_INKY_DOWN2]         = MakeTextureRect(sprite_sheet, { 341, 96, 16, 16 });
+    system->sprite_rects[SPRITE_ID_CLYDE_RIGHT1]       = MakeTextureRect(sprite_sheet, { 229, 112, 16, 16 });
+    system->sprite_rects[SPRITE_ID_CLYDE_RIGHT2]       = MakeTextureRect(sprite_sheet, { 245, 112, 16, 16 });
+    system->sprite_rects[SPRITE_ID_CLYDE_LEFT1]        = MakeTextureRect(sprite_sheet, { 261, 112, 16, 16 });
+    system->sprite_rects[SPRITE_ID_CLYDE_LEFT2]        = MakeTextureRect(sprite_sheet, { 277, 112, 16, 16 });
+    system->sprite_rects[SPRITE_ID_CLYDE_UP1]          = MakeTextureRect(sprite_sheet, { 293, 112, 16, 16 });
+    system->sprite_rects[SPRITE_ID_CLYDE_UP2]          = MakeTextureRect(sprite_sheet, { 309, 112, 16, 16 });
+    system->sprite_rects[SPRITE_ID_CLYDE_DOWN1]        = MakeTextureRect(sprite_sheet, { 325, 112, 16, 16 });
+    system->sprite_rects[SPRITE_ID_CLYDE_DOWN2]        = MakeTextureRect(sprite_sheet, { 341, 112, 16, 16 });
+    system->sprite_rects[SPRITE_ID_GHOST_FRIGHTENED1]  = MakeTextureRect(sprite_sheet, { 357, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_GHOST_FRIGHTENED2]  = MakeTextureRect(sprite_sheet, { 373, 64, 16, 16 });
+    system->sprite_rects[SPRITE_ID_GHOST_EATEN_RIGHT]  = MakeTextureRect(sprite_sheet, { 357, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_GHOST_EATEN_LEFT]   = MakeTextureRect(sprite_sheet, { 373, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_GHOST_EATEN_UP]     = MakeTextureRect(sprite_sheet, { 389, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_GHOST_EATEN_DOWN]   = MakeTextureRect(sprite_sheet, { 405, 80, 16, 16 });
+    system->sprite_rects[SPRITE_ID_MAZE]               = MakeTextureRect(sprite_sheet, { 1, 0, 224, 248 });
+    system->sprite_rects[SPRITE_ID_SMALL_DOT]          = MakeTextureRect(sprite_sheet, { 227, 242, 4, 4 });
+}
+
+void
+UpdateRenderSystem(World *world, RenderSystem *system, RenderQueue *queue) {
+    constexpr u32 MASK = MASK_TRANSFORM | MASK_SPRITE;
+    GrowChunkInstances(world, system);
+
+    // Only the chunks of the ghosts and Pacman change every frame.
+    // The maze and the dots keep the instances from the first frame.
+    f32 window_height = static_cast<f32>(world->window_size.y);
+    for (Chunk *chunk = NextChunk(world, MASK, 0); chunk; chunk = NextChunk(world, MASK, chunk)) {
+        if (HasChunkChanged(chunk, MASK, system->change_version)) {
+            SpriteInstance *instances = GetChunkInstances(system, chunk);
+            for (u32 row = 0; row < chunk->count; ++row) {
+                // We want (0, 0) to be the top left corner
+                SpriteInstance *instance = &instances[row];
+                instance->translate.x = chunk->translate_xs[row];
+                instance->translate.y = window_height - chunk->translate_ys[row];
+                instance->scale = chunk->scales[row];
+                instance->rect = system->sprite_rects[chunk->sprites[row].id];
+            }
+        }
+    }
+
+    // A dropped frame took its repairs of the static layer with it
+    bool is_frame_dropped;
+    RenderCommandList *commands = BeginWriteRenderCommands(queue, &is_frame_dropped);
+    if (is_frame_dropped) {
+        system->is_static_layer_valid = false;
+    }
+
+    // A dropped list comes back with the stats of an older frame
+    if (commands->stats.frame > system->stats.frame) {
+        system->stats = commands->stats;
+    }
+
+    BeginRenderCommands(commands, world->window_size, &system->sprite_sheet);
+    UpdateStaticLayer(world, system, commands);
+
+    // The static layer replaces clearing the screen. Chunks are walked
+    // in the order their archetypes were first used, and GameInit
+    // creates the maze first, then the dots, the ghosts, and Pacman, so
+    // they are drawn on top of each other in that order.
+    RectangleInt full_clip = GetFullClip(commands);
+    PushRenderCommand(commands, RENDER_COMMAND_COPY_STATIC_LAYER, RENDER_TARGET_SCREEN, full_clip);
+    PushRenderCommand(commands, RENDER_COMMAND_DRAW_SPRITES, RENDER_TARGET_SCREEN, full_clip);
+    for (Chunk *chunk = NextChunk(world, MASK, 0); chunk; chunk = NextChunk(world, MASK, chunk)) {
+        if (!IsStaticMask(chunk->mask)) {
+            SpriteInstance *instances = GetChunkInstances(system, chunk);
+            for (u32 row = 0; row < chunk->count; ++row) {
+                PushSprite(commands, &instances[row]);
+            }
+        }
+    }
+
+    EndWriteRenderCommands(queue);
+    system->change_version = world->change_version;
+}
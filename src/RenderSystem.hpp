@@ -0,0 +1,50 @@
+#ifndef PACMAN_RENDER_SYSTEM_HPP
+#define PACMAN_RENDER_SYSTEM_HPP
+#include "Common.hpp"
+#include "Renderer.hpp"
+#include "Systems.hpp"
+#include "World.hpp"
+
+
+// More damage than this in one frame redraws the whole static layer
+constexpr u32 MAX_STATIC_LAYER_DAMAGE = 16;
+
+// Turns the world into the render commands of a frame. Entities that
+// neither move nor animate, i.e., the maze and the small dots, are drawn
+// into the static layer and only redrawn where they change. Every frame
+// starts with a copy of the layer, and only the rest of the entities are
+// drawn on top of it. It only reads the World, between updates, so the
+// simulation builds and runs without it.
+struct RenderSystem {
+    // Every sprite is a frame of the one sprite sheet
+    Bitmap sprite_sheet;
+    TextureRect sprite_rects[SPRITE_ID_COUNT];
+
+    u32 change_version; // World::change_version of the last frame that was drawn
+
+    // CHUNK_CAPACITY instances for every Chunk::id. The instances of a
+    // chunk are only rebuilt when its transforms or sprites change.
+    SpriteInstance *chunk_instances;
+    u32 num_cached_chunks;
+
+    SpriteInstance *static_sprites; // What the static layer shows, in draw order
+    SpriteInstance *next_static_sprites;
+    u32 num_static_sprites;
+    u32 static_sprite_capacity;
+    bool is_static_layer_valid;
+
+    RenderStats stats; // The latest ones that came back from the render queue
+};
+
+
+
+// Loads the sprite sheet and finds the frames of the SPRITE_IDs in it
+void
+InitRenderSystem(RenderSystem *system, char *sprite_sheet_file_name);
+
+// Records the frame in the next list of queue. The static layer is only
+// repaired where it changed, unless the frame before was dropped.
+void
+UpdateRenderSystem(World *world, RenderSystem *system, RenderQueue *queue);
+
+#endif // PACMAN_RENDER_SYSTEM_HPP
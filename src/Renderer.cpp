@@ -0,0 +1,188 @@
+#include "Renderer.hpp"
+
+
+#pragma pack(push, 1)
+struct BitmapFile {
+    u16 signature;
+    u32 file_size;
+    u16 reserved1;
+    u16 reserved2;
+    u32 pixels_offset;
+    u32 size;
+    s32 width;
+    s32 height;
+    u16 planes;
+    u16 bits_per_pixel;
+};
+#pragma pack(pop)
+
+
+Bitmap
+LoadBitmapFile(char *file_name) {
+    File file = PlatformReadFile(file_name);
+    BitmapFile *bmp = static_cast<BitmapFile *>(file.buffer);
+    ASSERT(bmp->bits_per_pixel == 32);
+
+    Bitmap bitmap;
+    bitmap.file = file;
+    bitmap.width = bmp->width;
+    bitmap.height = bmp->height;
+    bitmap.pixels = reinterpret_cast<u32 *>(static_cast<u8 *>(file.buffer) + bmp->pixels_offset);
+    return bitmap;
+}
+
+void
+FreeBitmap(Bitmap *bitmap) {
+    PlatformFreeFile(bitmap->file);
+    *bitmap = {};
+}
+
+TextureRect
+MakeTextureRect(Bitmap *bitmap, RectangleInt rect) {
+    // The bitmap is stored bottom up, so the top of the texture is at 1
+    TextureRect result;
+    result.left = static_cast<f32>(rect.left) / bitmap->width;
+    result.top = 1.0f - (static_cast<f32>(rect.top) / bitmap->height);
+    result.right = result.left + (static_cast<f32>(rect.width) / bitmap->width);
+    result.bottom = result.top - (static_cast<f32>(rect.height) / bitmap->height);
+    return result;
+}
+
+void
+BeginRenderCommands(RenderCommandList *list, Vector2Int size, Bitmap *sprite_sheet) {
+    list->size = size;
+    list->sprite_sheet = sprite_sheet;
+    list->num_commands = 0;
+    list->num_sprites = 0;
+}
+
+RectangleInt
+GetFullClip(RenderCommandList *list) {
+    RectangleInt clip = { 0, 0, list->size.x, list->size.y };
+    return clip;
+}
+
+RenderCommand *
+PushRenderCommand(RenderCommandList *list, u32 type, u32 target, RectangleInt clip) {
+    ASSERT(target < RENDER_TARGET_COUNT);
+    if (list->num_commands == list->command_capacity) {
+        u32 new_capacity = (list->command_capacity > 0) ? list->command_capacity * 2 : 64;
+        RenderCommand *new_commands = static_cast<RenderCommand *>(PlatformAllocateMemory(new_capacity * sizeof(RenderCommand)));
+        for (u32 i = 0; i < list->num_commands; ++i) {
+            new_commands[i] = list->commands[i];
+        }
+
+        if (list->commands) {
+            PlatformFreeMemory(list->commands);
+        }
+
+        list->commands = new_commands;
+        list->command_capacity = new_capacity;
+    }
+
+    RenderCommand *command = &list->commands[list->num_commands];
+    list->num_commands += 1;
+    *command = {};
+    command->type = type;
+    command->target = target;
+    command->clip = clip;
+    command->first_sprite = list->num_sprites;
+    return command;
+}
+
+void
+PushSprite(RenderCommandList *list, SpriteInstance *sprite) {
+    ASSERT(list->num_commands > 0);
+    RenderCommand *command = &list->commands[list->num_commands - 1];
+    ASSERT(command->type == RENDER_COMMAND_DRAW_SPRITES);
+
+    if (list->num_sprites == list->sprite_capacity) {
+        u32 new_capacity = (list->sprite_capacity > 0) ? list->sprite_capacity * 2 : 256;
+        SpriteInstance *new_sprites = static_cast<SpriteInstance *>(PlatformAllocateMemory(new_capacity * sizeof(SpriteInstance)));
+        for (u32 i = 0; i < list->num_sprites; ++i) {
+            new_sprites[i] = list->sprites[i];
+        }
+
+        if (list->sprites) {
+            PlatformFreeMemory(list->sprites);
+        }
+
+        list->sprites = new_sprites;
+        list->sprite_capacity = new_capacity;
+    }
+
+    list->sprites[list->num_sprites] = *sprite;
+    list->num_sprites += 1;
+    command->num_sprites += 1;
+}
+
+void
+ExecuteRenderCommands(RenderBackend *backend, RenderCommandList *list) {
+    backend->execute(backend, list);
+}
+
+void
+InitRenderQueue(RenderQueue *queue) {
+    for (u32 i = 0; i < RENDER_QUEUE_LENGTH; ++i) {
+        queue->lists[i] = {};
+    }
+
+    queue->write_index = 0;
+    queue->read_index = 0;
+    queue->free_lists = PlatformCreateSemaphore(RENDER_QUEUE_LENGTH);
+    queue->ready_lists = PlatformCreateSemaphore(0);
+    queue->is_closed.store(false, std::memory_order_relaxed);
+}
+
+RenderCommandList *
+BeginWriteRenderCommands(RenderQueue *queue, bool *is_frame_dropped) {
+    *is_frame_dropped = !PlatformTryWaitSemaphore(queue->free_lists);
+    if (*is_frame_dropped) {
+        // The render thread holds at most one list, so at least two are
+        // ready. It draws them in order and cannot reach the newest one
+        // once its count is taken, even while it takes the one before.
+        bool is_ready = PlatformTryWaitSemaphore(queue->ready_lists);
+        ASSERT(is_ready);
+        queue->write_index = (queue->write_index + RENDER_QUEUE_LENGTH - 1) % RENDER_QUEUE_LENGTH;
+    }
+
+    return &queue->lists[queue->write_index];
+}
+
+void
+EndWriteRenderCommands(RenderQueue *queue) {
+    queue->write_index = (queue->write_index + 1) % RENDER_QUEUE_LENGTH;
+    PlatformSignalSemaphore(queue->ready_lists, 1);
+}
+
+RenderCommandList *
+BeginReadRenderCommands(RenderQueue *queue) {
+    PlatformWaitSemaphore(queue->ready_lists);
+    if (queue->is_closed.load(std::memory_order_acquire)) {
+        return 0;
+    }
+
+    return &queue->lists[queue->read_index];
+}
+
+void
+EndReadRenderCommands(RenderQueue *queue) {
+    queue->read_index = (queue->read_index + 1) % RENDER_QUEUE_LENGTH;
+    PlatformSignalSemaphore(queue->free_lists, 1);
+}
+
+void
+FlushRenderQueue(RenderQueue *queue) {
+    // Once the simulation holds every free list, no list is left to draw
+    for (u32 i = 0; i < RENDER_QUEUE_LENGTH; ++i) {
+        PlatformWaitSemaphore(queue->free_lists);
+    }
+
+    PlatformSignalSemaphore(queue->free_lists, RENDER_QUEUE_LENGTH);
+}
+
+void
+CloseRenderQueue(RenderQueue *queue) {
+    queue->is_closed.store(true, std::memory_order_release);
+    PlatformSignalSemaphore(queue->ready_lists, 1);
+}
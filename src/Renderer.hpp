@@ -0,0 +1,175 @@
+#ifndef PACMAN_RENDERER_HPP
+#define PACMAN_RENDERER_HPP
+#include <atomic>
+#include "Common.hpp"
+#include "Math.hpp"
+#include "Platform.hpp"
+
+
+// Pixels are 0xAARRGGBB and the rows go bottom up, as in the file
+struct Bitmap {
+    File file;
+    s32 width;
+    s32 height;
+    u32 *pixels;
+};
+
+// A rectangle of a texture in texture coordinates
+struct TextureRect {
+    f32 left;
+    f32 top;
+    f32 right;
+    f32 bottom;
+};
+
+// What the vertex shader needs to draw a sprite. translate is the center
+// of the sprite in window coordinates and scale is half of its size.
+struct SpriteInstance {
+    Vector2 translate;
+    Vector2 scale;
+    TextureRect rect;
+};
+
+static_assert(sizeof(SpriteInstance) == 8 * sizeof(f32), "SpriteInstance does not match the vertex shader");
+
+enum {
+    RENDER_TARGET_SCREEN,
+    RENDER_TARGET_STATIC_LAYER,
+
+    RENDER_TARGET_COUNT
+};
+
+enum {
+    RENDER_COMMAND_CLEAR,              // Makes the pixels transparent
+    RENDER_COMMAND_DRAW_SPRITES,       // Blends the sprites in order
+    RENDER_COMMAND_COPY_STATIC_LAYER,  // Replaces the pixels with the static layer
+};
+
+// Pixels outside of clip are not touched. clip is in pixels, and like
+// everything else here, y goes up from the bottom of the target, so
+// RectangleInt::top is its bottom edge.
+struct RenderCommand {
+    u32 type;
+    u32 target;
+    RectangleInt clip;
+    u32 first_sprite;
+    u32 num_sprites;
+};
+
+// How long the GPU took to draw a frame. The times arrive a few frames
+// after the frame was drawn, so frame says which one they belong to. It
+// counts the lists a backend executed, from 1, and stays 0 until a frame
+// was measured, e.g., with a backend that cannot measure.
+struct RenderStats {
+    u64 frame;
+    f32 static_layer_seconds; // Repairing the static layer
+    f32 screen_seconds; // Copying the static layer and drawing the sprites on top
+    f32 frame_seconds; // From the start of the frame before, SwapBuffers included
+};
+
+// A frame, as a list of commands that a RenderBackend executes in order.
+// Every sprite is a frame of sprite_sheet. Targets are as big as size.
+struct RenderCommandList {
+    Vector2Int size;
+    Bitmap *sprite_sheet;
+
+    RenderCommand *commands;
+    u32 num_commands;
+    u32 command_capacity;
+
+    SpriteInstance *sprites;
+    u32 num_sprites;
+    u32 sprite_capacity;
+
+    RenderStats stats; // The latest ones when the list was executed, set by the backend
+};
+
+struct RenderBackend;
+typedef void ExecuteRenderCommandsFunction(RenderBackend *backend, RenderCommandList *list);
+
+// Draws a RenderCommandList, with OpenGL or on the CPU
+struct RenderBackend {
+    ExecuteRenderCommandsFunction *execute;
+    void *data;
+};
+
+// One list for the frame that is being recorded, one for the frame that
+// is being drawn, and one for a frame that waits in between
+constexpr u32 RENDER_QUEUE_LENGTH = 3;
+
+// Hands the frames of the simulation to the render thread, in order. A
+// list that was written is only touched by the render thread until it is
+// done with it, so neither side takes a lock. The simulation never waits
+// for the render thread. When it gets a whole queue ahead, it takes back
+// the newest frame that was not drawn yet and writes the next one over
+// it, so the latest frame wins. The commands of a frame only repair the
+// static layer where it changed since the frame before, so the frame
+// that replaces a dropped one has to repair everything the dropped one
+// would have.
+struct RenderQueue {
+    RenderCommandList lists[RENDER_QUEUE_LENGTH];
+    u32 write_index; // Only used by the simulation
+    u32 read_index; // Only used by the render thread
+    void *free_lists; // Semaphore, counts the lists that can be written
+    void *ready_lists; // Semaphore, counts the lists that can be drawn
+    std::atomic<bool> is_closed;
+};
+
+
+Bitmap
+LoadBitmapFile(char *file_name);
+
+void
+FreeBitmap(Bitmap *bitmap);
+
+TextureRect
+MakeTextureRect(Bitmap *bitmap, RectangleInt rect);
+
+void
+BeginRenderCommands(RenderCommandList *list, Vector2Int size, Bitmap *sprite_sheet);
+
+// The clip of a command that touches the whole target
+RectangleInt
+GetFullClip(RenderCommandList *list);
+
+// The pointer is only valid until the next command is pushed
+RenderCommand *
+PushRenderCommand(RenderCommandList *list, u32 type, u32 target, RectangleInt clip);
+
+// Adds the sprite to the last command, which has to draw sprites
+void
+PushSprite(RenderCommandList *list, SpriteInstance *sprite);
+
+void
+ExecuteRenderCommands(RenderBackend *backend, RenderCommandList *list);
+
+void
+InitRenderQueue(RenderQueue *queue);
+
+// Never waits. is_frame_dropped is set when no list was free, and the
+// list is the one of the frame before, which will not be drawn.
+RenderCommandList *
+BeginWriteRenderCommands(RenderQueue *queue, bool *is_frame_dropped);
+
+// Hands the list of BeginWriteRenderCommands to the render thread
+void
+EndWriteRenderCommands(RenderQueue *queue);
+
+// Waits until a list was written. Returns 0 once the queue is closed.
+RenderCommandList *
+BeginReadRenderCommands(RenderQueue *queue);
+
+// Gives the list of BeginReadRenderCommands back to the simulation
+void
+EndReadRenderCommands(RenderQueue *queue);
+
+// Waits until every list that was written has been drawn. Only the
+// simulation may call it.
+void
+FlushRenderQueue(RenderQueue *queue);
+
+// Wakes up the render thread for good
+void
+CloseRenderQueue(RenderQueue *queue);
+
+#endif // PACMAN_RENDERER_HPP
@@ -0,0 +1,117 @@
+#include "Scheduler.hpp"
+
+
+static void
+RunScheduledSystem(void *data) {
+    ScheduledSystem *system = static_cast<ScheduledSystem *>(data);
+    Scheduler *scheduler = system->scheduler;
+    system->function(scheduler->world, &system->commands, system->data);
+
+    // Every dependent is counted in its pending_dependencies until
+    // it is started, so it cannot be started twice
+    for (u32 i = 0; i < scheduler->num_systems; ++i) {
+        ScheduledSystem *dependent = &scheduler->systems[i];
+        if ((system->dependents & (1 << i)) && SignalCounter(&dependent->pending_dependencies) &&
+            !dependent->is_main_thread_only) {
+            AddJob(RunScheduledSystem, dependent, &scheduler->counter);
+        }
+    }
+}
+
+static u32
+CountBits(u32 mask) {
+    u32 count = 0;
+    for (; mask; mask &= mask - 1) {
+        count += 1;
+    }
+
+    return count;
+}
+
+void
+InitScheduler(Scheduler *scheduler, World *world) {
+    scheduler->world = world;
+    scheduler->num_systems = 0;
+    scheduler->counter.remaining = 0;
+}
+
+void
+AddSystem(Scheduler *scheduler, SystemFunction *function, void *data, u32 reads, u32 writes, bool is_main_thread_only) {
+    ASSERT(scheduler->num_systems < MAX_SCHEDULED_SYSTEMS);
+    ScheduledSystem *system = &scheduler->systems[scheduler->num_systems];
+    system->function = function;
+    system->data = data;
+    system->scheduler = scheduler;
+    system->reads = reads;
+    system->writes = writes;
+    system->is_main_thread_only = is_main_thread_only;
+    system->dependencies = 0;
+    system->dependents = 0;
+    system->pending_dependencies.remaining = 0;
+    system->commands = {};
+    for (u32 i = 0; i < scheduler->num_systems; ++i) {
+        ScheduledSystem *earlier = &scheduler->systems[i];
+        if ((earlier->writes & (system->reads | system->writes)) || (earlier->reads & system->writes)) {
+            system->dependencies |= 1 << i;
+            earlier->dependents |= 1 << scheduler->num_systems;
+        }
+    }
+
+    scheduler->num_systems += 1;
+}
+
+void
+RunSystems(Scheduler *scheduler) {
+    scheduler->world->change_version += 1;
+    scheduler->world->is_structure_locked = true;
+    if (scheduler->world->is_single_threaded || GetWorkerCount() == 0) {
+        // The order they were added in satisfies every dependency
+        for (u32 i = 0; i < scheduler->num_systems; ++i) {
+            ScheduledSystem *system = &scheduler->systems[i];
+            system->function(scheduler->world, &system->commands, system->data);
+        }
+    }
+    else {
+        // Set every count before the first system can finish
+        for (u32 i = 0; i < scheduler->num_systems; ++i) {
+            ScheduledSystem *system = &scheduler->systems[i];
+            system->pending_dependencies.remaining = CountBits(system->dependencies);
+        }
+
+        for (u32 i = 0; i < scheduler->num_systems; ++i) {
+            ScheduledSystem *system = &scheduler->systems[i];
+            if (system->dependencies == 0 && !system->is_main_thread_only) {
+                AddJob(RunScheduledSystem, system, &scheduler->counter);
+            }
+        }
+
+        // Waiting runs the jobs of the other systems in the meantime
+        for (u32 i = 0; i < scheduler->num_systems; ++i) {
+            ScheduledSystem *system = &scheduler->systems[i];
+            if (system->is_main_thread_only) {
+                WaitForCounter(&system->pending_dependencies);
+                RunScheduledSystem(system);
+            }
+        }
+
+        WaitForCounter(&scheduler->counter);
+    }
+
+    scheduler->world->is_structure_locked = false;
+
+    // The systems have already seen this frame's version,
+    // so the rows that are moved now get a newer one
+    scheduler->world->change_version += 1;
+    for (u32 i = 0; i < scheduler->num_systems; ++i) {
+        PlayCommands(scheduler->world, &scheduler->systems[i].commands);
+    }
+}
+
+void
+FreeScheduler(Scheduler *scheduler) {
+    for (u32 i = 0; i < scheduler->num_systems; ++i) {
+        FreeCommandBuffer(&scheduler->systems[i].commands);
+    }
+
+    scheduler->num_systems = 0;
+}
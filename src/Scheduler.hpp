@@ -0,0 +1,74 @@
+#ifndef PACMAN_SCHEDULER_HPP
+#define PACMAN_SCHEDULER_HPP
+#include "Common.hpp"
+#include "Commands.hpp"
+#include "Jobs.hpp"
+#include "World.hpp"
+
+
+constexpr u32 MAX_SCHEDULED_SYSTEMS = 32;
+
+// What a system reads and writes. The component masks are used as they
+// are, and these bits are for the data that is not stored in the World.
+enum {
+    ACCESS_MAZE         = 1 << (COMPONENT_COUNT + 0),
+    ACCESS_GHOSTS       = 1 << (COMPONENT_COUNT + 1), // The Ghost components in GhostAiSystem
+};
+
+// Systems must not change the structure of the World directly. They
+// record the changes in their command buffer instead.
+typedef void SystemFunction(World *world, CommandBuffer *commands, void *data);
+
+struct Scheduler;
+
+struct ScheduledSystem {
+    SystemFunction *function;
+    void *data;
+    Scheduler *scheduler;
+    u32 reads;
+    u32 writes;
+    bool is_main_thread_only; // E.g., because it makes OpenGL calls
+
+    // Bit i is set if the system has to wait for system i, or if
+    // system i has to wait for this one
+    u32 dependencies;
+    u32 dependents;
+    JobCounter pending_dependencies; // The dependencies that did not finish this frame
+    CommandBuffer commands;
+};
+
+// Systems run in the order they were added, except that a system does
+// not wait for the earlier systems it does not conflict with. Two systems
+// conflict if one of them writes what the other reads or writes. Since
+// conflicting systems always run in the order they were added, the results
+// are the same as when running them one after the other.
+//
+// The systems without dependencies are started at once, and the last
+// dependency of a system to finish starts it, so a slow system only holds
+// up the systems that conflict with it. Systems that must run on the main
+// thread are run there in the order they were added.
+//
+// The command buffers are played back in the same order once every system
+// has finished, so structural changes show up in the next frame.
+struct Scheduler {
+    World *world;
+    ScheduledSystem systems[MAX_SCHEDULED_SYSTEMS];
+    u32 num_systems;
+    JobCounter counter; // The systems that run as jobs
+};
+
+
+void
+InitScheduler(Scheduler *scheduler, World *world);
+
+void
+AddSystem(Scheduler *scheduler, SystemFunction *function, void *data, u32 reads, u32 writes, bool is_main_thread_only);
+
+// Returns when every system has finished and the commands have been played back
+void
+RunSystems(Scheduler *scheduler);
+
+void
+FreeScheduler(Scheduler *scheduler);
+
+#endif // PACMAN_SCHEDULER_HPP
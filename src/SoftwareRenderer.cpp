@@ -0,0 +1,310 @@
+#include <math.h>
+#include "SoftwareRenderer.hpp"
+#include "Platform.hpp"
+
+#ifdef PACMAN_SSE2
+    #include <immintrin.h>
+#endif
+
+
+static s32
+Floor(f32 a) {
+    s32 result = static_cast<s32>(a);
+    return (a < result) ? result - 1 : result;
+}
+
+// Rasterizers snap vertices to 1/256 of a pixel, rounding ties to even
+constexpr s32 SUBPIXELS = 256;
+
+static s32
+Snap(f32 a) {
+    return static_cast<s32>(lrintf(a * SUBPIXELS));
+}
+
+// The first pixel whose center is at or right of a snapped coordinate
+static s32
+FirstPixelAfter(s32 a) {
+    s32 b = a + SUBPIXELS / 2 - 1;
+    return (b >= 0) ? b / SUBPIXELS : -((SUBPIXELS - 1 - b) / SUBPIXELS);
+}
+
+// What the projection of the sprite batch and the viewport make of a
+// coordinate, rounded the same way
+static f32
+ToWindow(f32 a, s32 size) {
+    f32 half_size = 0.5f * size;
+    f32 ndc = (2.0f / size) * a - 1.0f;
+    return fmaf(ndc, half_size, half_size);
+}
+
+// OpenGL blends with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA on every channel,
+// alpha included. (t + (t >> 8)) >> 8 is t / 255, rounded.
+static u32
+BlendPixel(u32 source, u32 destination) {
+    u32 alpha = source >> 24;
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        u32 s = (source >> shift) & 0xff;
+        u32 d = (destination >> shift) & 0xff;
+        u32 t = s * alpha + d * (255 - alpha) + 128;
+        result |= ((t + (t >> 8)) >> 8) << shift;
+    }
+
+    return result;
+}
+
+#if defined(PACMAN_AVX2)
+static const bool HAS_AVX2 = PlatformHasAvx2();
+
+// BlendPixel for 8 pixels, 16 bits per channel
+AVX2_FUNCTION static __m256i
+BlendPixels(__m256i sources, __m256i destinations) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i max = _mm256_set1_epi16(255);
+    __m256i half = _mm256_set1_epi16(128);
+
+    __m256i results[2];
+    for (u32 i = 0; i < 2; ++i) {
+        __m256i s = i ? _mm256_unpackhi_epi8(sources, zero) : _mm256_unpacklo_epi8(sources, zero);
+        __m256i d = i ? _mm256_unpackhi_epi8(destinations, zero) : _mm256_unpacklo_epi8(destinations, zero);
+        __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(s, alpha), _mm256_mullo_epi16(d, _mm256_sub_epi16(max, alpha)));
+        t = _mm256_add_epi16(t, half);
+        results[i] = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+
+    return _mm256_packus_epi16(results[0], results[1]);
+}
+
+// BlendRow for 8 pixels at a time, from i on. Returns the first pixel it
+// did not blend.
+AVX2_FUNCTION static s32
+BlendRowAvx2(u32 *destination, u32 *texels, s32 *columns, s32 i, s32 count) {
+    __m256i minus_ones = _mm256_set1_epi32(-1);
+    for (; i + 8 <= count; i += 8) {
+        __m256i indices = _mm256_loadu_si256(reinterpret_cast<__m256i *>(&columns[i]));
+        __m256i is_inside = _mm256_cmpgt_epi32(indices, minus_ones);
+        __m256i sources = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<int *>(texels), indices, is_inside, 4);
+        __m256i destinations = _mm256_loadu_si256(reinterpret_cast<__m256i *>(&destination[i]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&destination[i]), BlendPixels(sources, destinations));
+    }
+
+    return i;
+}
+#endif
+
+#if defined(PACMAN_SSE2)
+// BlendPixel for 4 pixels, 16 bits per channel
+static __m128i
+BlendPixels(__m128i sources, __m128i destinations) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i max = _mm_set1_epi16(255);
+    __m128i half = _mm_set1_epi16(128);
+
+    __m128i results[2];
+    for (u32 i = 0; i < 2; ++i) {
+        __m128i s = i ? _mm_unpackhi_epi8(sources, zero) : _mm_unpacklo_epi8(sources, zero);
+        __m128i d = i ? _mm_unpackhi_epi8(destinations, zero) : _mm_unpacklo_epi8(destinations, zero);
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, alpha), _mm_mullo_epi16(d, _mm_sub_epi16(max, alpha)));
+        t = _mm_add_epi16(t, half);
+        results[i] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    return _mm_packus_epi16(results[0], results[1]);
+}
+
+// BlendRow for 4 pixels at a time, see BlendRowAvx2
+static s32
+BlendRowSse2(u32 *destination, u32 *texels, s32 *columns, s32 i, s32 count) {
+    for (; i + 4 <= count; i += 4) {
+        u32 gathered[4];
+        for (s32 j = 0; j < 4; ++j) {
+            gathered[j] = (columns[i + j] >= 0) ? texels[columns[i + j]] : 0;
+        }
+
+        __m128i sources = _mm_loadu_si128(reinterpret_cast<__m128i *>(gathered));
+        __m128i destinations = _mm_loadu_si128(reinterpret_cast<__m128i *>(&destination[i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&destination[i]), BlendPixels(sources, destinations));
+    }
+
+    return i;
+}
+#endif
+
+// Blends texels[columns[i]] into destination[i]. A column of -1 is outside
+// of the texture, which is transparent like GL_CLAMP_TO_BORDER.
+static void
+BlendRow(u32 *destination, u32 *texels, s32 *columns, s32 count) {
+    s32 i = 0;
+#if defined(PACMAN_AVX2)
+    if (HAS_AVX2) {
+        i = BlendRowAvx2(destination, texels, columns, i, count);
+    }
+#endif
+#if defined(PACMAN_SSE2)
+    i = BlendRowSse2(destination, texels, columns, i, count);
+#endif
+
+    for (; i < count; ++i) {
+        u32 source = (columns[i] >= 0) ? texels[columns[i]] : 0;
+        destination[i] = BlendPixel(source, destination[i]);
+    }
+}
+
+static void
+BlendTexelRow(u32 *destination, Bitmap *sprite_sheet, s32 row, s32 *columns, s32 count) {
+    if (row >= 0 && row < sprite_sheet->height && count > 0) {
+        BlendRow(destination, &sprite_sheet->pixels[row * sprite_sheet->width], columns, count);
+    }
+}
+
+// Covers the pixels whose centers are inside the sprite, and samples the
+// texel under every center, which is what OpenGL does with GL_NEAREST.
+// Where a center is right on the edge between two texels, the choice
+// depends on how the driver rounds, so the texture coordinates are
+// interpolated the way Mesa's llvmpipe does it: the plane of a triangle
+// starts at its first vertex, and every pixel is a fused multiply-add
+// away from it. u comes out the same in both triangles of the quad, but
+// v starts at the top left corner in the top left triangle and at the
+// bottom left corner in the other one. This only holds if the compiler
+// does not contract the other multiplies and adds, which /fp:precise
+// does not. Sprites that cross the edge of the window get clipped by
+// OpenGL first, so a texel on their edge can still come out different.
+static void
+DrawSprite(SoftwareRenderer *renderer, u32 *pixels, RectangleInt clip, Bitmap *sprite_sheet, SpriteInstance *sprite) {
+    Vector2Int size = renderer->size;
+    f32 left = ToWindow(sprite->translate.x - sprite->scale.x, size.x);
+    f32 right = ToWindow(sprite->translate.x + sprite->scale.x, size.x);
+    f32 bottom = ToWindow(sprite->translate.y - sprite->scale.y, size.y);
+    f32 top = ToWindow(sprite->translate.y + sprite->scale.y, size.y);
+
+    // Coverage only depends on the snapped corners
+    s64 snapped_left = Snap(left);
+    s64 snapped_right = Snap(right);
+    s64 snapped_bottom = Snap(bottom);
+    s64 snapped_top = Snap(top);
+    s32 first_x = FirstPixelAfter(static_cast<s32>(snapped_left));
+    s32 end_x = FirstPixelAfter(static_cast<s32>(snapped_right));
+    s32 first_y = FirstPixelAfter(static_cast<s32>(snapped_bottom));
+    s32 end_y = FirstPixelAfter(static_cast<s32>(snapped_top));
+    first_x = (first_x > clip.left) ? first_x : clip.left;
+    end_x = (end_x < clip.left + clip.width) ? end_x : clip.left + clip.width;
+    first_y = (first_y > clip.top) ? first_y : clip.top;
+    end_y = (end_y < clip.top + clip.height) ? end_y : clip.top + clip.height;
+    if (first_x >= end_x || first_y >= end_y) {
+        return;
+    }
+
+    TextureRect rect = sprite->rect;
+    f32 one_over_area = 1.0f / ((left - right) * (top - bottom));
+    f32 du_dx = (rect.left - rect.right) * ((top - bottom) * one_over_area);
+    f32 dv_dy = (rect.top - rect.bottom) * ((left - right) * one_over_area);
+    f32 u0 = rect.left - du_dx * (left - 0.5f);
+    f32 bottom_v0 = rect.bottom - dv_dy * (bottom - 0.5f);
+    f32 top_v0 = rect.top - dv_dy * (top - 0.5f);
+    f32 width = static_cast<f32>(sprite_sheet->width);
+    f32 height = static_cast<f32>(sprite_sheet->height);
+
+    s32 *columns = renderer->texel_columns;
+    for (s32 x = first_x; x < end_x; ++x) {
+        s32 column = Floor(fmaf(du_dx, static_cast<f32>(x), u0) * width);
+        columns[x - first_x] = (column >= 0 && column < sprite_sheet->width) ? column : -1;
+    }
+
+    s32 count = end_x - first_x;
+    for (s32 y = first_y; y < end_y; ++y) {
+        u32 *destination = &pixels[y * size.x + first_x];
+        s32 bottom_row = Floor(fmaf(dv_dy, static_cast<f32>(y), bottom_v0) * height);
+        s32 top_row = Floor(fmaf(dv_dy, static_cast<f32>(y), top_v0) * height);
+        if (bottom_row == top_row) {
+            BlendTexelRow(destination, sprite_sheet, bottom_row, columns, count);
+            continue;
+        }
+
+        // The centers above the diagonal from the bottom left to
+        // the top right corner are in the top left triangle
+        s64 center_y = static_cast<s64>(y) * SUBPIXELS + SUBPIXELS / 2;
+        s32 split = 0;
+        while (split < count) {
+            s64 center_x = static_cast<s64>(first_x + split) * SUBPIXELS + SUBPIXELS / 2;
+            s64 side = (snapped_right - snapped_left) * (center_y - snapped_bottom) -
+                       (snapped_top - snapped_bottom) * (center_x - snapped_left);
+            if (side <= 0) {
+                break;
+            }
+
+            split += 1;
+        }
+
+        BlendTexelRow(destination, sprite_sheet, top_row, columns, split);
+        BlendTexelRow(destination + split, sprite_sheet, bottom_row, columns + split, count - split);
+    }
+}
+
+// The damage of a sprite on the edge can reach past the target, where
+// OpenGL's scissor test clamps it
+static RectangleInt
+ClipToTarget(RectangleInt clip, Vector2Int size) {
+    s32 left = (clip.left > 0) ? clip.left : 0;
+    s32 top = (clip.top > 0) ? clip.top : 0;
+    s32 right = (clip.left + clip.width < size.x) ? clip.left + clip.width : size.x;
+    s32 bottom = (clip.top + clip.height < size.y) ? clip.top + clip.height : size.y;
+    RectangleInt result;
+    result.left = left;
+    result.top = top;
+    result.width = (right > left) ? right - left : 0;
+    result.height = (bottom > top) ? bottom - top : 0;
+    return result;
+}
+
+static void
+ExecuteSoftwareRenderCommands(RenderBackend *backend, RenderCommandList *list) {
+    SoftwareRenderer *renderer = static_cast<SoftwareRenderer *>(backend->data);
+    ASSERT(list->size == renderer->size);
+    s32 pitch = renderer->size.x;
+    for (u32 i = 0; i < list->num_commands; ++i) {
+        RenderCommand *command = &list->commands[i];
+        u32 *pixels = renderer->targets[command->target];
+        RectangleInt clip = ClipToTarget(command->clip, renderer->size);
+        switch (command->type) {
+            case RENDER_COMMAND_CLEAR: {
+                for (s32 y = clip.top; y < clip.top + clip.height; ++y) {
+                    for (s32 x = clip.left; x < clip.left + clip.width; ++x) {
+                        pixels[y * pitch + x] = 0;
+                    }
+                }
+            } break;
+            case RENDER_COMMAND_DRAW_SPRITES: {
+                for (u32 j = 0; j < command->num_sprites; ++j) {
+                    DrawSprite(renderer, pixels, clip, list->sprite_sheet, &list->sprites[command->first_sprite + j]);
+                }
+            } break;
+            case RENDER_COMMAND_COPY_STATIC_LAYER: {
+                u32 *layer = renderer->targets[RENDER_TARGET_STATIC_LAYER];
+                for (s32 y = clip.top; y < clip.top + clip.height; ++y) {
+                    for (s32 x = clip.left; x < clip.left + clip.width; ++x) {
+                        pixels[y * pitch + x] = layer[y * pitch + x];
+                    }
+                }
+            } break;
+        }
+    }
+}
+
+RenderBackend
+InitSoftwareRenderer(SoftwareRenderer *renderer, Vector2Int size) {
+    *renderer = {};
+    renderer->size = size;
+    u64 target_size = static_cast<u64>(size.x) * size.y * sizeof(u32);
+    for (u32 i = 0; i < RENDER_TARGET_COUNT; ++i) {
+        renderer->targets[i] = static_cast<u32 *>(PlatformAllocateMemory(target_size));
+    }
+
+    renderer->texel_columns = static_cast<s32 *>(PlatformAllocateMemory(size.x * sizeof(s32)));
+
+    RenderBackend backend;
+    backend.execute = ExecuteSoftwareRenderCommands;
+    backend.data = renderer;
+    return backend;
+}
@@ -0,0 +1,21 @@
+#ifndef PACMAN_SOFTWARE_RENDERER_HPP
+#define PACMAN_SOFTWARE_RENDERER_HPP
+#include "Common.hpp"
+#include "Math.hpp"
+#include "Renderer.hpp"
+
+
+// The RenderBackend that draws on the CPU, for machines without a GPU.
+// Sprites are scaled with nearest neighbour sampling and blended like
+// OpenGL blends them, so the frames match the OpenGL renderer.
+struct SoftwareRenderer {
+    Vector2Int size;
+    u32 *targets[RENDER_TARGET_COUNT]; // Pixels as in Bitmap, bottom up
+    s32 *texel_columns; // Scratch, the column of the sprite sheet of every pixel in a row
+};
+
+
+RenderBackend
+InitSoftwareRenderer(SoftwareRenderer *renderer, Vector2Int size);
+
+#endif // PACMAN_SOFTWARE_RENDERER_HPP
@@ -1,8 +1,11 @@
 #include "Systems.hpp"
-#include "OpenGL.hpp"
 
+#ifdef PACMAN_SSE2
+    #include <immintrin.h>
+#endif
 
-static Vector2Int
+
+Vector2Int
 ToCellCoordinates(Vector2 translate, Vector2 cell_size) {
     Vector2Int cell;
     cell.x = static_cast<s32>(translate.x / cell_size.x);
@@ -64,93 +67,158 @@ IsVertical(u32 direction) {
 }
 
 void
-UpdateAnimationSystem(World *world, AnimationSystem *system) {
-    constexpr u32 MASK = MASK_SPRITE | MASK_ANIMATION;
-    for (Entity entity = 0; entity < MAX_ENTITIES; ++entity) {
-        if ((world->entity_masks[entity] & MASK) != MASK) {
-            continue;
-        }
-
-        Animation *animation = &world->animations[entity];
-        if (animation->is_finished) {
-            continue;
-        }
+UpdateAnimationSystem(World *world) {
+    constexpr u32 CHUNKS_PER_JOB = 1;
+    f32 delta_time = world->delta_time;
+    u32 change_version = world->change_version;
+    ParallelForEachChunk(world, MASK_ANIMATION | MASK_SPRITE, MASK_ANIMATION, CHUNKS_PER_JOB, [=](Chunk *chunk) {
+        // Most ticks show the same frame, and a changed
+        // Sprite makes the render system rebuild the chunk
+        bool is_sprite_changed = false;
+        for (u32 row = 0; row < chunk->count; ++row) {
+            Animation *animation = &chunk->animations[row];
+            if (animation->is_finished) {
+                continue;
+            }
 
-        animation->seconds_since_last_frame += world->delta_time;
-        if (animation->seconds_between_frames <= animation->seconds_since_last_frame) {
-            animation->seconds_since_last_frame = 0.0f;
-            Sprite *sprite  = &world->sprites[entity];
+            animation->seconds_since_last_frame += delta_time;
+            if (animation->seconds_between_frames <= animation->seconds_since_last_frame) {
+                animation->seconds_since_last_frame = 0.0f;
 
-            sprite->vertex_array = system->vertex_arrays[animation->base_sprite_id + animation->current_sprite_id];
-            if (!animation->is_looped && animation->is_reversed) {
-                animation->is_finished = true;
-            }
-            else if (animation->num_frames > 1) {
-                if (animation->is_reversed) {
-                    animation->current_sprite_id -= 1;
-                    animation->is_reversed = animation->current_sprite_id != 0;
+                u8 sprite_id = animation->base_sprite_id + animation->current_sprite_id;
+                is_sprite_changed |= (chunk->sprites[row].id != sprite_id);
+                chunk->sprites[row].id = sprite_id;
+                if (!animation->is_looped && animation->is_reversed) {
+                    animation->is_finished = true;
                 }
-                else {
-                    animation->current_sprite_id += 1;
-                    animation->is_reversed = animation->current_sprite_id == animation->num_frames - 1;
+                else if (animation->num_frames > 1) {
+                    if (animation->is_reversed) {
+                        animation->current_sprite_id -= 1;
+                        animation->is_reversed = animation->current_sprite_id != 0;
+                    }
+                    else {
+                        animation->current_sprite_id += 1;
+                        animation->is_reversed = animation->current_sprite_id == animation->num_frames - 1;
+                    }
                 }
             }
         }
-    }
-}
 
-void
-UpdateRenderSystem(World *world) {
-    constexpr u32 MASK = MASK_TRANSFORM | MASK_SPRITE;
-    glClear(GL_COLOR_BUFFER_BIT);
-    for (Entity entity = 0; entity < MAX_ENTITIES; ++entity) {
-        if ((world->entity_masks[entity] & MASK) != MASK) {
-            continue;
+        if (is_sprite_changed) {
+            MarkChunkChanged(chunk, MASK_SPRITE, change_version);
         }
+    });
+}
 
-        Transform *transform = &world->transforms[entity];
-        Sprite *sprite = &world->sprites[entity];
+// The unit vector of every direction. The tables are as wide as an AVX2
+// register, so the rows after DIRECTION_NONE are padding that does not move.
+static const f32 DIRECTION_XS[SIMD_WIDTH] = { 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+static const f32 DIRECTION_YS[SIMD_WIDTH] = { -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+static_assert(DIRECTION_UP == 0 && DIRECTION_LEFT == 1 && DIRECTION_DOWN == 2 && DIRECTION_RIGHT == 3 && DIRECTION_NONE < SIMD_WIDTH,
+              "DIRECTION_XS and DIRECTION_YS do not match the directions");
+
+#if defined(PACMAN_AVX2)
+static const bool HAS_AVX2 = PlatformHasAvx2();
+
+AVX2_FUNCTION u32
+MoveRowsAvx2(f32 *xs, f32 *ys, const Motion *motions, u32 row, u32 count, f32 delta_time) {
+    __m256 direction_xs = _mm256_loadu_ps(DIRECTION_XS);
+    __m256 direction_ys = _mm256_loadu_ps(DIRECTION_YS);
+    __m256 delta_times = _mm256_set1_ps(delta_time);
+    for (; row + 8 <= count; row += 8) {
+        // Motion is { speed, direction }, so two loads hold 8 of them. The
+        // shuffles work within 128 bit lanes, which leaves the rows in the
+        // order 0 1 4 5 2 3 6 7, and the permutes put them back in order.
+        __m256 motions_lo = _mm256_load_ps(reinterpret_cast<const f32 *>(&motions[row]));
+        __m256 motions_hi = _mm256_load_ps(reinterpret_cast<const f32 *>(&motions[row + 4]));
+        __m256 speeds = _mm256_shuffle_ps(motions_lo, motions_hi, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 directions = _mm256_shuffle_ps(motions_lo, motions_hi, _MM_SHUFFLE(3, 1, 3, 1));
+        speeds = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(speeds), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256i direction_ids = _mm256_permute4x64_epi64(_mm256_castps_si256(directions), _MM_SHUFFLE(3, 1, 2, 0));
+
+        __m256 distances = _mm256_mul_ps(speeds, delta_times);
+        __m256 velocity_xs = _mm256_permutevar8x32_ps(direction_xs, direction_ids);
+        __m256 velocity_ys = _mm256_permutevar8x32_ps(direction_ys, direction_ids);
+        _mm256_store_ps(&xs[row], _mm256_add_ps(_mm256_load_ps(&xs[row]), _mm256_mul_ps(velocity_xs, distances)));
+        _mm256_store_ps(&ys[row], _mm256_add_ps(_mm256_load_ps(&ys[row]), _mm256_mul_ps(velocity_ys, distances)));
+    }
 
-        glBindTexture(GL_TEXTURE_2D, sprite->texture.handle);
-        glBindVertexArray(sprite->vertex_array.id);
+    return row;
+}
+#endif
+
+#if defined(PACMAN_SSE2)
+u32
+MoveRowsSse2(f32 *xs, f32 *ys, const Motion *motions, u32 row, u32 count, f32 delta_time) {
+    // There is no variable permute in SSE2, so the
+    // unit vectors are built from compares instead
+    __m128 ones = _mm_set1_ps(1.0f);
+    __m128i ups = _mm_set1_epi32(DIRECTION_UP);
+    __m128i lefts = _mm_set1_epi32(DIRECTION_LEFT);
+    __m128i downs = _mm_set1_epi32(DIRECTION_DOWN);
+    __m128i rights = _mm_set1_epi32(DIRECTION_RIGHT);
+    __m128 delta_times = _mm_set1_ps(delta_time);
+    for (; row + 4 <= count; row += 4) {
+        __m128 motions_lo = _mm_load_ps(reinterpret_cast<const f32 *>(&motions[row]));
+        __m128 motions_hi = _mm_load_ps(reinterpret_cast<const f32 *>(&motions[row + 2]));
+        __m128 speeds = _mm_shuffle_ps(motions_lo, motions_hi, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128i direction_ids = _mm_castps_si128(_mm_shuffle_ps(motions_lo, motions_hi, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        __m128 distances = _mm_mul_ps(speeds, delta_times);
+        __m128 velocity_xs = _mm_sub_ps(_mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(direction_ids, rights)), ones),
+                                        _mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(direction_ids, lefts)), ones));
+        __m128 velocity_ys = _mm_sub_ps(_mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(direction_ids, downs)), ones),
+                                        _mm_and_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(direction_ids, ups)), ones));
+        _mm_store_ps(&xs[row], _mm_add_ps(_mm_load_ps(&xs[row]), _mm_mul_ps(velocity_xs, distances)));
+        _mm_store_ps(&ys[row], _mm_add_ps(_mm_load_ps(&ys[row]), _mm_mul_ps(velocity_ys, distances)));
+    }
 
-        // We want (0, 0) to be the top left corner
-        Vector2 translate;
-        translate.x = transform->translate.x;
-        translate.y = world->window_size.y - transform->translate.y;
+    return row;
+}
+#endif
+
+u32
+MoveRowsScalar(f32 *xs, f32 *ys, const Motion *motions, u32 row, u32 count, f32 delta_time) {
+    for (; row < count; ++row) {
+        u32 direction = motions[row].direction;
+        f32 distance = motions[row].speed * delta_time;
+        xs[row] += DIRECTION_XS[direction] * distance;
+        ys[row] += DIRECTION_YS[direction] * distance;
+    }
 
-        Matrix4 model = IDENDITY_MATRIX4;
-        model = Scale(model, transform->scale);
-        model = Translate(model, translate);
-        SetMatrix4Uniform("model", model);
+    return row;
+}
 
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+// Moves every row by its direction times speed without branching, with
+// the widest instructions the CPU has, and the rest one row at a time.
+// The columns of a chunk are 32 byte aligned, see CHUNK_CAPACITY.
+static void
+MoveRows(f32 *xs, f32 *ys, const Motion *motions, u32 count, f32 delta_time) {
+    u32 row = 0;
+#if defined(PACMAN_AVX2)
+    if (HAS_AVX2) {
+        row = MoveRowsAvx2(xs, ys, motions, row, count, delta_time);
     }
+#endif
+#if defined(PACMAN_SSE2)
+    row = MoveRowsSse2(xs, ys, motions, row, count, delta_time);
+#endif
+    MoveRowsScalar(xs, ys, motions, row, count, delta_time);
 }
 
 void
 UpdateMovementSystem(World *world) {
-    constexpr u32 MASK = MASK_TRANSFORM | MASK_MOTION;
-    for (Entity entity = 0; entity < MAX_ENTITIES; ++entity) {
-        if ((world->entity_masks[entity] & MASK) != MASK) {
-            continue;
-        }
-
-        Transform *transform = &world->transforms[entity];
-        Motion *motion = &world->motions[entity];
-
-        f32 speed = motion->speed * world->delta_time;
-        switch (motion->direction) {
-            case DIRECTION_LEFT:  { transform->translate.x -= speed; } break;
-            case DIRECTION_RIGHT: { transform->translate.x += speed; } break;
-            case DIRECTION_DOWN:  { transform->translate.y += speed; } break;
-            case DIRECTION_UP:    { transform->translate.y -= speed; } break;
-        }
-    }
+    // Moving an entity is only a few instructions, so
+    // a job gets more chunks than in the animation system
+    constexpr u32 CHUNKS_PER_JOB = 4;
+    f32 delta_time = world->delta_time;
+    ParallelForEachChunk(world, MASK_TRANSFORM | MASK_MOTION, MASK_TRANSFORM, CHUNKS_PER_JOB, [=](Chunk *chunk) {
+        MoveRows(chunk->translate_xs, chunk->translate_ys, chunk->motions, chunk->count, delta_time);
+    });
 }
 
 void
-UpdatePlayerInputSystem(World *world, PlayerInputSystem *system) {
+UpdatePlayerInputSystem(World *world, CommandBuffer *commands, PlayerInputSystem *system) {
     if (system->is_dead) {
         return;
     }
@@ -163,8 +231,9 @@ UpdatePlayerInputSystem(World *world, PlayerInputSystem *system) {
         case KEY_W: { system->next_direction = DIRECTION_UP;    } break;
     }
 
-    Animation *animation = &world->animations[system->pacman];
-    Motion *motion = &world->motions[system->pacman];
+    Animation *animation = GetAnimation(world, system->pacman);
+    Motion *motion = GetMotion(world, system->pacman);
+    MarkChanged(world, system->pacman, MASK_ANIMATION | MASK_MOTION);
 
     // This if-statement is required so that the player can move in a new
     // direction instantly if the new direction is on the same line as
@@ -173,10 +242,10 @@ UpdatePlayerInputSystem(World *world, PlayerInputSystem *system) {
         (IsVertical(system->next_direction) && IsVertical(motion->direction))) {
         motion->direction = system->next_direction;
         animation->base_sprite_id = system->base_sprite_ids[motion->direction];
-        world->entity_masks[system->pacman] |= MASK_ANIMATION;
+        RecordAddComponents(commands, system->pacman, MASK_ANIMATION);
     }
 
-    Vector2 translate = world->transforms[system->pacman].translate;
+    Vector2 translate = GetTransform(world, system->pacman).translate;
     Vector2Int cell = ToCellCoordinates(translate, world->cell_size);
     Vector2 cell_center = cell * world->cell_size + world->half_cell_size;
 
@@ -185,46 +254,60 @@ UpdatePlayerInputSystem(World *world, PlayerInputSystem *system) {
     // then the player cannot move when the game starts.
     if (AreRoughlyEquals(translate, cell_center) || (motion->direction == DIRECTION_NONE && system->next_direction != DIRECTION_NONE)) {
         Vector2Int possible_next_cell = Move(cell, system->next_direction);
-        if (!IsWall(possible_next_cell)) {
+        if (!IsWall(system->maze, possible_next_cell)) {
             motion->direction = system->next_direction;
             animation->base_sprite_id = system->base_sprite_ids[motion->direction];
-            world->entity_masks[system->pacman] |= MASK_ANIMATION;
+            RecordAddComponents(commands, system->pacman, MASK_ANIMATION);
         }
         else {
             Vector2Int next_cell = Move(cell, motion->direction);
-            if (IsWall(next_cell)) {
+            if (IsWall(system->maze, next_cell)) {
                 motion->direction = DIRECTION_NONE;
-                world->entity_masks[system->pacman] &= ~MASK_ANIMATION;
+                RecordRemoveComponents(commands, system->pacman, MASK_ANIMATION);
             }
         }
     }
 
-    if (IsCell(cell, d) || IsCell(cell, D)) {
-        for (u32 entity = 0; entity < MAX_ENTITIES; ++entity) {
-            Vector2 entity_translate = world->transforms[entity].translate;
-            Vector2Int entity_cell = ToCellCoordinates(entity_translate, world->cell_size);
-            // TODO: Ensure that this entity is a dot. We might remove a ghost or pacman
-            if (entity_cell == cell) {
-                world->entity_masks[entity] = MASK_NONE;
-                if (IsCell(cell, D)) {
-                    for (u32 i = 0; i < GHOST_COUNT; ++i) {
-                        system->ghosts[i]->state = STATE_FRIGHTENED;
-                        system->ghosts[i]->is_state_init = false;
+    if (IsCell(system->maze, cell, d) || IsCell(system->maze, cell, D)) {
+        bool is_dot_eaten = false;
+        for (Chunk *chunk = NextChunk(world, MASK_TRANSFORM, 0); chunk && !is_dot_eaten; chunk = NextChunk(world, MASK_TRANSFORM, chunk)) {
+            // Ghosts and Pacman are the only entities that move, so
+            // skipping them leaves the dots. The maze is never on a dot cell.
+            if (chunk->mask & MASK_MOTION) {
+                continue;
+            }
+
+            for (u32 row = 0; row < chunk->count; ++row) {
+                Vector2 entity_translate = { chunk->translate_xs[row], chunk->translate_ys[row] };
+                Vector2Int entity_cell = ToCellCoordinates(entity_translate, world->cell_size);
+                if (entity_cell == cell) {
+                    RecordDestroyEntity(commands, chunk->entities[row]);
+                    system->score += IsCell(system->maze, cell, D) ? BIG_DOT_POINTS : SMALL_DOT_POINTS;
+                    if (IsCell(system->maze, cell, D)) {
+                        for (u32 i = 0; i < GHOST_COUNT; ++i) {
+                            system->ghosts[i]->state = STATE_FRIGHTENED;
+                            system->ghosts[i]->is_state_init = false;
+                        }
                     }
-                }
 
-                SetEmpty(cell);
-                break;
+                    SetEmpty(system->maze, cell);
+                    is_dot_eaten = true;
+                    break;
+                }
             }
         }
     }
 
     for (u32 i = 0; i < GHOST_COUNT; ++i) {
         Ghost *ghost = system->ghosts[i];
-        Vector2 ghost_translate = world->transforms[ghost->id].translate;
+        Vector2 ghost_translate = GetTransform(world, ghost->id).translate;
         Vector2Int ghost_cell = ToCellCoordinates(ghost_translate, world->cell_size);
         if (ghost_cell == cell) {
             if (ghost->state == STATE_FRIGHTENED || ghost->state == STATE_EATEN) {
+                if (ghost->state == STATE_FRIGHTENED) {
+                    system->score += GHOST_POINTS;
+                }
+
                 ghost->state = STATE_EATEN;
                 ghost->is_state_init = false;
             }
@@ -235,10 +318,9 @@ UpdatePlayerInputSystem(World *world, PlayerInputSystem *system) {
                 animation->is_reversed = false;
                 animation->seconds_between_frames = 0.1f;
                 system->is_dead = true;
-                world->entity_masks[system->pacman] &= ~MASK_MOTION;
-                world->entity_masks[system->pacman] |= MASK_ANIMATION;
+                RecordChangeMask(commands, system->pacman, MASK_MOTION, MASK_ANIMATION);
                 for (u32 j = 0; j < GHOST_COUNT; ++j) {
-                    world->entity_masks[system->ghosts[j]->id] &= ~MASK_TRANSFORM;
+                    RecordRemoveComponents(commands, system->ghosts[j]->id, MASK_TRANSFORM);
                 }
             }
 
@@ -252,15 +334,16 @@ UpdateGhostAiSystem(World *world, GhostAiSystem *system) {
     constexpr u32 MASK = MASK_TRANSFORM;
     for (u32 i = 0; i < GHOST_COUNT; ++i) {
         Ghost *ghost = &system->ghosts[i];
-        if ((world->entity_masks[ghost->id] & MASK) != MASK) {
+        if ((GetMask(world, ghost->id) & MASK) != MASK) {
             continue;
         }
 
-        Animation *animation = &world->animations[ghost->id];
-        Motion *motion = &world->motions[ghost->id];
+        Animation *animation = GetAnimation(world, ghost->id);
+        Motion *motion = GetMotion(world, ghost->id);
+        MarkChanged(world, ghost->id, MASK_ANIMATION | MASK_MOTION);
         ghost->seconds_in_current_state += world->delta_time;
 
-        Vector2 translate = world->transforms[ghost->id].translate;
+        Vector2 translate = GetTransform(world, ghost->id).translate;
         Vector2Int cell = ToCellCoordinates(translate, world->cell_size);
         if (!ghost->is_state_init) {
             ghost->seconds_in_current_state = 0.0f;
@@ -268,7 +351,7 @@ UpdateGhostAiSystem(World *world, GhostAiSystem *system) {
 
         switch (ghost->state) {
             case STATE_CHASE: {
-                Vector2 pacman_translate = world->transforms[system->pacman].translate;
+                Vector2 pacman_translate = GetTransform(world, system->pacman).translate;
                 ghost->target_cell = ToCellCoordinates(pacman_translate, world->cell_size);
                 if (ghost->seconds_in_current_state >= 20.0f) {
                     ghost->state = STATE_SCATTER;
@@ -354,14 +437,14 @@ UpdateGhostAiSystem(World *world, GhostAiSystem *system) {
         if (AreRoughlyEquals(translate, cell_center) || (IsVertical(motion->direction) && AreRoughlyEquals(translate.y, cell_center.y))) {
             Vector2Int next_cell = Move(cell, motion->direction);
             u32 next_direction = DIRECTION_NONE;
-            if (IsWall(next_cell)) {
+            if (IsWall(system->maze, next_cell)) {
                 if (IsHorizontal(motion->direction)) {
                     Vector2Int cell_up = Move(cell, DIRECTION_UP);
-                    next_direction = (IsWall(cell_up)) ? DIRECTION_DOWN : DIRECTION_UP;
+                    next_direction = (IsWall(system->maze, cell_up)) ? DIRECTION_DOWN : DIRECTION_UP;
                 }
                 else {
                     Vector2Int cell_left = Move(cell, DIRECTION_LEFT);
-                    next_direction = (IsWall(cell_left)) ? DIRECTION_RIGHT : DIRECTION_LEFT;
+                    next_direction = (IsWall(system->maze, cell_left)) ? DIRECTION_RIGHT : DIRECTION_LEFT;
                 }
             }
 
@@ -374,7 +457,7 @@ UpdateGhostAiSystem(World *world, GhostAiSystem *system) {
                 for (u32 direction = DIRECTION_UP; direction <= DIRECTION_RIGHT; ++direction) {
                     Vector2Int possible_next_cell = Move(cell, direction);
                     distance = EuclideanDistanceSquared(possible_next_cell, ghost->target_cell);
-                    if (distance < best_distance && !IsWall(possible_next_cell) && direction != reverse_direction) {
+                    if (distance < best_distance && !IsWall(system->maze, possible_next_cell) && direction != reverse_direction) {
                         best_distance = distance;
                         best_direction = direction;
                     }
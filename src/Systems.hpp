@@ -1,6 +1,7 @@
 #ifndef PACMAN_SYSTEMS_HPP
 #define PACMAN_SYSTEMS_HPP
 #include "Common.hpp"
+#include "Commands.hpp"
 #include "Math.hpp"
 #include "Maze.hpp"
 #include "Platform.hpp"
@@ -71,6 +72,8 @@ enum {
     SPRITE_ID_GHOST_EATEN_RIGHT,
     SPRITE_ID_GHOST_EATEN_UP,
     SPRITE_ID_GHOST_EATEN_DOWN,
+    SPRITE_ID_MAZE,
+    SPRITE_ID_SMALL_DOT,
 
     SPRITE_ID_COUNT
 };
@@ -101,9 +104,9 @@ enum {
     GHOST_COUNT
 };
 
-struct AnimationSystem {
-    VertexArray vertex_arrays[SPRITE_ID_COUNT];
-};
+constexpr u32 SMALL_DOT_POINTS = 10;
+constexpr u32 BIG_DOT_POINTS = 50;
+constexpr u32 GHOST_POINTS = 200;
 
 // No need to make a 'PlayerMovementComponent'.
 // We just store the needed information here.
@@ -113,26 +116,48 @@ struct PlayerInputSystem {
     u32 next_direction;
     u8 base_sprite_ids[4]; // 4, one for each direction
     Ghost *ghosts[GHOST_COUNT];
+    Maze *maze;
+    u32 score;
     bool is_dead;
 };
 
 struct GhostAiSystem {
     Entity pacman;
     Ghost ghosts[GHOST_COUNT];
+    Maze *maze;
 };
 
 
-void
-UpdateAnimationSystem(World *world, AnimationSystem *system);
+// Not clamped, so check the result before indexing the Maze with it
+Vector2Int
+ToCellCoordinates(Vector2 translate, Vector2 cell_size);
 
 void
-UpdateRenderSystem(World *world);
+UpdateAnimationSystem(World *world);
 
 void
 UpdateMovementSystem(World *world);
 
+// The kernels of the movement system, which move the rows from row on,
+// as many at a time as their instructions fit, and return the first row
+// they did not move. They give the same positions, so each one can finish
+// what the one before left. The columns have to be 32 byte aligned.
+// MoveRowsAvx2 may only be called when PlatformHasAvx2.
+#if defined(PACMAN_AVX2)
+AVX2_FUNCTION u32
+MoveRowsAvx2(f32 *xs, f32 *ys, const Motion *motions, u32 row, u32 count, f32 delta_time);
+#endif
+
+#if defined(PACMAN_SSE2)
+u32
+MoveRowsSse2(f32 *xs, f32 *ys, const Motion *motions, u32 row, u32 count, f32 delta_time);
+#endif
+
+u32
+MoveRowsScalar(f32 *xs, f32 *ys, const Motion *motions, u32 row, u32 count, f32 delta_time);
+
 void
-UpdatePlayerInputSystem(World *world, PlayerInputSystem *system);
+UpdatePlayerInputSystem(World *world, CommandBuffer *commands, PlayerInputSystem *system);
 
 void
 UpdateGhostAiSystem(World *world, GhostAiSystem *system);
@@ -0,0 +1,412 @@
+#ifdef PACMAN_TESTS
+#include <stdio.h>
+#include <string.h>
+#include "Common.hpp"
+#include "Game.hpp"
+#include "Jobs.hpp"
+#include "Platform.hpp"
+#include "Renderer.hpp"
+#include "Scheduler.hpp"
+#include "SoftwareRenderer.hpp"
+#include "Systems.hpp"
+
+
+// Checks what comparing the frames of pacman_headless cannot, e.g.,
+// memory outside of a target that no frame shows. Prints every check
+// that fails and returns 1 if there was one.
+static u32 num_failed_checks;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        num_failed_checks += 1; \
+    }
+
+constexpr u32 CANARY = 0xdeadbeef;
+constexpr s32 WINDOW_SIZE = 800;
+constexpr f32 TICK_SECONDS = 1.0f / 60.0f;
+
+
+static Input
+MakeInput(s32 key) {
+    Input input = {};
+    input.last_pressed_key = key;
+    input.is_key_down[key] = (key != KEY_NONE);
+    return input;
+}
+
+// Turns left and up for a while, then runs into the ghosts
+static void
+PlayGame(GameState *game, u32 num_ticks) {
+    for (u32 tick = 0; tick < num_ticks; ++tick) {
+        GameUpdate(game, TICK_SECONDS, MakeInput(((tick / 60) % 2) ? KEY_W : KEY_A));
+    }
+}
+
+static bool
+AreWorldsEqual(World *a, World *b) {
+    Chunk *chunk_b = NextChunk(b, MASK_NONE, 0);
+    for (Chunk *chunk_a = NextChunk(a, MASK_NONE, 0); chunk_a; chunk_a = NextChunk(a, MASK_NONE, chunk_a)) {
+        if (!chunk_b || chunk_a->mask != chunk_b->mask || chunk_a->count != chunk_b->count) {
+            return false;
+        }
+
+        for (u32 row = 0; row < chunk_a->count; ++row) {
+            if (chunk_a->translate_xs[row] != chunk_b->translate_xs[row] ||
+                chunk_a->translate_ys[row] != chunk_b->translate_ys[row] ||
+                chunk_a->sprites[row].id != chunk_b->sprites[row].id) {
+                return false;
+            }
+        }
+
+        chunk_b = NextChunk(b, MASK_NONE, chunk_b);
+    }
+
+    return chunk_b == 0;
+}
+
+
+// Clips that reach past the edges of the target must not write outside of it
+static void
+TestSoftwareRendererClipsToTarget() {
+    constexpr s32 SIZE = 8;
+    constexpr s32 PADDING = SIZE * SIZE;
+    SoftwareRenderer renderer;
+    RenderBackend backend = InitSoftwareRenderer(&renderer, { SIZE, SIZE });
+
+    // The screen gets a row of canaries on both sides
+    u32 *screen = static_cast<u32 *>(PlatformAllocateMemory((SIZE * SIZE + 2 * PADDING) * sizeof(u32)));
+    for (s32 i = 0; i < SIZE * SIZE + 2 * PADDING; ++i) {
+        screen[i] = CANARY;
+    }
+
+    renderer.targets[RENDER_TARGET_SCREEN] = screen + PADDING;
+    for (s32 i = 0; i < SIZE * SIZE; ++i) {
+        renderer.targets[RENDER_TARGET_STATIC_LAYER][i] = 0xff00ff00;
+    }
+
+    u32 texel = 0xffffffff;
+    Bitmap sprite_sheet = {};
+    sprite_sheet.width = 1;
+    sprite_sheet.height = 1;
+    sprite_sheet.pixels = &texel;
+
+    SpriteInstance sprite;
+    sprite.translate = { SIZE, SIZE };
+    sprite.scale = { SIZE / 2.0f, SIZE / 2.0f };
+    sprite.rect = MakeTextureRect(&sprite_sheet, { 0, 0, 1, 1 });
+
+    RenderCommandList list = {};
+    BeginRenderCommands(&list, { SIZE, SIZE }, &sprite_sheet);
+    PushRenderCommand(&list, RENDER_COMMAND_CLEAR, RENDER_TARGET_SCREEN, { -3, 5, 20, 10 });
+    PushRenderCommand(&list, RENDER_COMMAND_COPY_STATIC_LAYER, RENDER_TARGET_SCREEN, { 4, -2, 9, 7 });
+    PushRenderCommand(&list, RENDER_COMMAND_DRAW_SPRITES, RENDER_TARGET_SCREEN, { -10, -10, 40, 40 });
+    PushSprite(&list, &sprite);
+    ExecuteRenderCommands(&backend, &list);
+
+    for (s32 i = 0; i < PADDING; ++i) {
+        CHECK(screen[i] == CANARY);
+        CHECK(screen[PADDING + SIZE * SIZE + i] == CANARY);
+    }
+
+    u32 *pixels = renderer.targets[RENDER_TARGET_SCREEN];
+    CHECK(pixels[6 * SIZE + 0] == 0);
+    CHECK(pixels[1 * SIZE + 5] == 0xff00ff00);
+    CHECK(pixels[(SIZE - 1) * SIZE + SIZE - 1] == 0xffffffff);
+}
+
+
+// A game that is started over plays like a new one
+static void
+TestResetGameMatchesNewGame() {
+    static GameState reset_game;
+    static GameState new_game;
+    GameInit(&reset_game, WINDOW_SIZE, WINDOW_SIZE);
+    PlayGame(&reset_game, 900);
+    CHECK(reset_game.player_input_system.score > 0);
+    ResetGame(&reset_game);
+
+    GameInit(&new_game, WINDOW_SIZE, WINDOW_SIZE);
+    CHECK(reset_game.maze.num_dots == new_game.maze.num_dots);
+    CHECK(AreWorldsEqual(&reset_game.world, &new_game.world));
+    PlayGame(&reset_game, 900);
+    PlayGame(&new_game, 900);
+    CHECK(reset_game.player_input_system.score == new_game.player_input_system.score);
+    CHECK(AreWorldsEqual(&reset_game.world, &new_game.world));
+
+    FreeGame(&reset_game);
+    FreeGame(&new_game);
+}
+
+
+// A system can record a mask change after another command destroyed the
+// entity, and the change is dropped instead of reviving the handle
+static void
+TestMaskChangeOfDestroyedEntityIsDropped() {
+    World world = {};
+    InitWorld(&world, 1);
+    Entity entity = CreateEntity(&world);
+    CommandBuffer commands = {};
+    RecordDestroyEntity(&commands, entity);
+    RecordAddComponents(&commands, entity, MASK_SPRITE);
+    PlayCommands(&world, &commands);
+    CHECK(commands.num_commands == 0);
+    CHECK(!IsEntityAlive(&world, entity));
+
+    Entity next = CreateEntity(&world);
+    CHECK(EntityIndex(next) == EntityIndex(entity));
+    CHECK(GetMask(&world, next) == MASK_NONE);
+    FreeCommandBuffer(&commands);
+    FreeWorld(&world);
+}
+
+
+typedef u32 MoveRowsFunction(f32 *xs, f32 *ys, const Motion *motions, u32 row, u32 count, f32 delta_time);
+
+// Every kernel of the movement system moves the rows it can to the same
+// positions, bit for bit, as the scalar one, which moves the rest. There
+// is one row more than 3 AVX2 registers, so every kernel leaves a tail.
+static void
+TestMoveRowsKernelsMatch() {
+    constexpr u32 COUNT = 3 * 8 + 5;
+    alignas(32) static Motion motions[COUNT];
+    alignas(32) static f32 start_xs[COUNT];
+    alignas(32) static f32 start_ys[COUNT];
+    for (u32 row = 0; row < COUNT; ++row) {
+        motions[row].speed = 150.0f + 3.3f * row;
+        motions[row].direction = row % (DIRECTION_NONE + 1);
+        start_xs[row] = 100.25f + 13.7f * row;
+        start_ys[row] = 700.5f - 21.1f * row;
+    }
+
+    alignas(32) static f32 expected_xs[COUNT];
+    alignas(32) static f32 expected_ys[COUNT];
+    memcpy(expected_xs, start_xs, sizeof(start_xs));
+    memcpy(expected_ys, start_ys, sizeof(start_ys));
+    CHECK(MoveRowsScalar(expected_xs, expected_ys, motions, 0, COUNT, TICK_SECONDS) == COUNT);
+
+    MoveRowsFunction *kernels[2] = {};
+    u32 num_kernels = 0;
+#if defined(PACMAN_SSE2)
+    kernels[num_kernels++] = MoveRowsSse2;
+#endif
+#if defined(PACMAN_AVX2)
+    if (PlatformHasAvx2()) {
+        kernels[num_kernels++] = MoveRowsAvx2;
+    }
+#endif
+
+    for (u32 i = 0; i < num_kernels; ++i) {
+        alignas(32) static f32 xs[COUNT];
+        alignas(32) static f32 ys[COUNT];
+        memcpy(xs, start_xs, sizeof(start_xs));
+        memcpy(ys, start_ys, sizeof(start_ys));
+        u32 row = kernels[i](xs, ys, motions, 0, COUNT, TICK_SECONDS);
+        CHECK(row > 0 && row < COUNT);
+        MoveRowsScalar(xs, ys, motions, row, COUNT, TICK_SECONDS);
+        CHECK(memcmp(xs, expected_xs, sizeof(xs)) == 0);
+        CHECK(memcmp(ys, expected_ys, sizeof(ys)) == 0);
+    }
+}
+
+
+// A record whose generation runs out is retired instead of handing out
+// an old handle again
+static void
+TestEntityGenerationIsNotReused() {
+    World world = {};
+    InitWorld(&world, 1);
+    Entity first = CreateEntity(&world);
+    Entity entity = first;
+    for (u32 generation = 1; generation < ENTITY_GENERATION_MASK; ++generation) {
+        DestroyEntity(&world, entity);
+        entity = CreateEntity(&world);
+        CHECK(EntityIndex(entity) == EntityIndex(first));
+        CHECK(EntityGeneration(entity) == generation);
+    }
+
+    DestroyEntity(&world, entity);
+    entity = CreateEntity(&world);
+    CHECK(EntityIndex(entity) != EntityIndex(first));
+    CHECK(!IsEntityAlive(&world, first));
+
+    // Clearing the World retires the same way
+    ClearWorld(&world);
+    CHECK(!IsEntityAlive(&world, entity));
+    Entity second = CreateEntity(&world);
+    CHECK(EntityIndex(second) == EntityIndex(entity));
+    CHECK(EntityGeneration(second) == 1);
+    FreeWorld(&world);
+}
+
+
+// The simulation never waits for the render thread. When it is a whole
+// queue ahead, the newest frame makes room, and the rest stay in order.
+static void
+TestRenderQueueDropsNewestFrame() {
+    RenderQueue queue;
+    InitRenderQueue(&queue);
+    Bitmap sprite_sheet = {};
+    for (s32 frame = 1; frame <= 4; ++frame) {
+        bool is_frame_dropped;
+        RenderCommandList *list = BeginWriteRenderCommands(&queue, &is_frame_dropped);
+        CHECK(is_frame_dropped == (frame == 4));
+        BeginRenderCommands(list, { frame, frame }, &sprite_sheet);
+        EndWriteRenderCommands(&queue);
+    }
+
+    s32 drawn_frames[] = { 1, 2, 4 };
+    for (s32 frame : drawn_frames) {
+        RenderCommandList *list = BeginReadRenderCommands(&queue);
+        CHECK(list && list->size.x == frame);
+        EndReadRenderCommands(&queue);
+    }
+
+    CloseRenderQueue(&queue);
+    CHECK(BeginReadRenderCommands(&queue) == 0);
+}
+
+
+static void
+SleepJob(void *data) {
+    PlatformSleep(0.02f);
+    static_cast<std::atomic<u32> *>(data)->fetch_add(1, std::memory_order_relaxed);
+}
+
+// The jobs take long enough for WaitForCounter to stop spinning and sleep
+// until the last one is done, which has to wake it up
+static void
+TestWaitForCounterWakesUp() {
+    std::atomic<u32> num_done(0);
+    JobCounter counter;
+    counter.remaining = 0;
+    for (u32 i = 0; i < 4; ++i) {
+        AddJob(SleepJob, &num_done, &counter);
+    }
+
+    WaitForCounter(&counter);
+    CHECK(counter.remaining.load() == 0);
+    CHECK(num_done.load() == 4);
+}
+
+
+struct ScheduleTrace {
+    std::atomic<bool> is_slow_system_done;
+    bool was_done_before_dependent; // Seen by the system that waits for the slow one
+    bool was_done_before_independent; // Seen by the system that does not
+};
+
+static void
+RunSlowSystem(World *, CommandBuffer *, void *data) {
+    PlatformSleep(0.05f);
+    static_cast<ScheduleTrace *>(data)->is_slow_system_done.store(true);
+}
+
+static void
+RunDependentSystem(World *, CommandBuffer *, void *data) {
+    ScheduleTrace *trace = static_cast<ScheduleTrace *>(data);
+    trace->was_done_before_dependent = trace->is_slow_system_done.load();
+}
+
+static void
+RunIndependentSystem(World *, CommandBuffer *, void *data) {
+    ScheduleTrace *trace = static_cast<ScheduleTrace *>(data);
+    trace->was_done_before_independent = trace->is_slow_system_done.load();
+}
+
+// A system that was added after a slow one, and does not conflict with
+// it, starts while the slow one runs
+static void
+TestSchedulerStartsIndependentSystems() {
+    World world = {};
+    InitWorld(&world, 1);
+    Scheduler scheduler;
+    InitScheduler(&scheduler, &world);
+
+    ScheduleTrace trace;
+    trace.is_slow_system_done = false;
+    trace.was_done_before_dependent = false;
+    trace.was_done_before_independent = true;
+    AddSystem(&scheduler, RunSlowSystem, &trace, MASK_NONE, ACCESS_MAZE, false);
+    AddSystem(&scheduler, RunDependentSystem, &trace, ACCESS_MAZE, MASK_NONE, false);
+    AddSystem(&scheduler, RunIndependentSystem, &trace, MASK_NONE, ACCESS_GHOSTS, false);
+    RunSystems(&scheduler);
+
+    CHECK(trace.is_slow_system_done.load());
+    CHECK(trace.was_done_before_dependent);
+    CHECK(!trace.was_done_before_independent);
+    FreeScheduler(&scheduler);
+    FreeWorld(&world);
+}
+
+
+// A single threaded game runs every system and chunk on the calling
+// thread, so it adds no jobs even when the systems use ParallelForEach
+static void
+TestSingleThreadedGameAddsNoJobs() {
+    static GameState game;
+    GameInit(&game, WINDOW_SIZE, WINDOW_SIZE);
+    u64 num_pushed_jobs = GetPushedJobCount();
+    PlayGame(&game, 60);
+    CHECK(GetPushedJobCount() > num_pushed_jobs);
+
+    ResetGame(&game);
+    game.world.is_single_threaded = true;
+    num_pushed_jobs = GetPushedJobCount();
+    PlayGame(&game, 900);
+    CHECK(GetPushedJobCount() == num_pushed_jobs);
+    FreeGame(&game);
+}
+
+
+// Splitting the systems and chunks between the workers must not change the
+// game, so it plays the same as one that runs everything on the main thread
+static void
+TestSingleThreadedGameMatchesThreadedGame() {
+    static GameState threaded_game;
+    static GameState single_threaded_game;
+    GameInit(&threaded_game, WINDOW_SIZE, WINDOW_SIZE);
+    GameInit(&single_threaded_game, WINDOW_SIZE, WINDOW_SIZE);
+    single_threaded_game.world.is_single_threaded = true;
+
+    u64 num_pushed_jobs = GetPushedJobCount();
+    PlayGame(&threaded_game, 900);
+    CHECK(GetPushedJobCount() > num_pushed_jobs);
+    PlayGame(&single_threaded_game, 900);
+    CHECK(threaded_game.player_input_system.score > 0);
+    CHECK(threaded_game.player_input_system.score == single_threaded_game.player_input_system.score);
+    CHECK(AreWorldsEqual(&threaded_game.world, &single_threaded_game.world));
+
+    FreeGame(&threaded_game);
+    FreeGame(&single_threaded_game);
+}
+
+
+
+s32
+main() {
+    // The main thread also runs jobs, so it is not counted as a worker.
+    // There are always a few, so that the jobs are added even on one core.
+    u32 num_workers = PlatformGetProcessorCount() - 1;
+    InitJobSystem((num_workers < 3) ? 3 : num_workers);
+    TestSoftwareRendererClipsToTarget();
+    TestResetGameMatchesNewGame();
+    TestEntityGenerationIsNotReused();
+    TestMaskChangeOfDestroyedEntityIsDropped();
+    TestMoveRowsKernelsMatch();
+    TestRenderQueueDropsNewestFrame();
+    TestWaitForCounterWakesUp();
+    TestSchedulerStartsIndependentSystems();
+    TestSingleThreadedGameAddsNoJobs();
+    TestSingleThreadedGameMatchesThreadedGame();
+
+    if (num_failed_checks > 0) {
+        printf("%u checks failed\n", num_failed_checks);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
+
+#endif // PACMAN_TESTS
@@ -1,21 +1,39 @@
+#ifdef _WIN32
 #include <Windows.h>
+#include <immintrin.h>
+#include <intrin.h>
+#include <stdio.h>
 #include "Common.hpp"
+#include "FramePacer.hpp"
 #include "Game.hpp"
+#include "Jobs.hpp"
 #include "OpenGL.hpp"
 #include "Platform.hpp"
+#include "RenderSystem.hpp"
 
 
 constexpr s32 WINDOW_WIDTH = 800;
 constexpr s32 WINDOW_HEIGHT = WINDOW_WIDTH;
+// The render queue never waits for the render thread, so the frame
+// pacer is what keeps the main loop from spinning
+constexpr f32 TARGET_FRAME_RATE = 60.0f;
+static_assert(TARGET_FRAME_RATE > 0.0f, "The main loop needs a frame rate");
+constexpr s32 SWAP_INTERVAL = 1; // Vertical blanks SwapBuffers waits for, 0 does not wait
 static bool is_window_open = true;
+static s64 performance_frequency;
+static GameState game;
 
+// The render thread owns the OpenGL context once the game is running
+struct Win32RenderThread {
+    HDC device_context;
+    HGLRC gl_rendering_context;
+    RenderBackend backend;
+    RenderQueue *queue;
+    void *stopped; // Semaphore, signaled when the context is released
+};
+
+typedef BOOL WINAPI Win32SwapIntervalFunction(int interval);
 
-static s64
-Win32GetWallClock() {
-    LARGE_INTEGER time;
-    QueryPerformanceCounter(&time);
-    return time.QuadPart;
-}
 
 static HGLRC
 Win32OpenGLGetRenderingContext(HDC device_context) {
@@ -83,7 +101,7 @@ Win32WindowCallback(HWND window, UINT message, WPARAM w_param, LPARAM l_param) {
 static HWND
 Win32CreateWindow(HINSTANCE instance) {
     WNDCLASS window_class = {};
-    window_class.style = CS_HREDRAW | CS_VREDRAW;
+    window_class.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
     window_class.lpfnWndProc = Win32WindowCallback;
     window_class.hInstance = instance;
     window_class.lpszClassName = "PacmanWindowClass";
@@ -147,6 +165,7 @@ PlatformReadFile(char *file_name) {
     CloseHandle(file_handle);
     File file;
     file.buffer = buffer;
+    file.size = file_bytes;
     return file;
 }
 
@@ -156,12 +175,156 @@ PlatformFreeFile(File file) {
     VirtualFree(file.buffer, 0, MEM_RELEASE);
 }
 
+void *
+PlatformAllocateMemory(u64 size) {
+    void *memory = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!memory) {
+        PlatformShowErrorAndExit("Could not allocate memory");
+    }
+
+    return memory;
+}
+
+void
+PlatformFreeMemory(void *memory) {
+    ASSERT(memory);
+    VirtualFree(memory, 0, MEM_RELEASE);
+}
+
 void
 PlatformShowErrorAndExit(char *msg) {
     MessageBox(0, msg, "Error", MB_OK);
     is_window_open = false;
 }
 
+struct Win32ThreadStart {
+    PlatformThreadFunction *function;
+    void *data;
+};
+
+static DWORD WINAPI
+Win32ThreadProc(LPVOID parameter) {
+    Win32ThreadStart *start = static_cast<Win32ThreadStart *>(parameter);
+    start->function(start->data);
+    return 0;
+}
+
+void
+PlatformStartThread(PlatformThreadFunction *function, void *data) {
+    // Threads run until the process exits, so start is never freed
+    Win32ThreadStart *start = static_cast<Win32ThreadStart *>(PlatformAllocateMemory(sizeof(Win32ThreadStart)));
+    start->function = function;
+    start->data = data;
+    HANDLE thread = CreateThread(0, 0, Win32ThreadProc, start, 0, 0);
+    if (!thread) {
+        PlatformShowErrorAndExit("Could not create thread");
+    }
+
+    CloseHandle(thread);
+}
+
+u32
+PlatformGetProcessorCount() {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return system_info.dwNumberOfProcessors;
+}
+
+bool
+PlatformHasAvx2() {
+    s32 info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    // AVX needs the OS to save the upper halves of the registers
+    __cpuid(info, 1);
+    bool has_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+    if (!has_avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+void *
+PlatformCreateSemaphore(u32 initial_count) {
+    HANDLE semaphore = CreateSemaphoreEx(0, initial_count, LONG_MAX, 0, 0, SEMAPHORE_ALL_ACCESS);
+    if (!semaphore) {
+        PlatformShowErrorAndExit("Could not create semaphore");
+    }
+
+    return semaphore;
+}
+
+void
+PlatformSignalSemaphore(void *semaphore, u32 count) {
+    ReleaseSemaphore(semaphore, count, 0);
+}
+
+void
+PlatformWaitSemaphore(void *semaphore) {
+    WaitForSingleObjectEx(semaphore, INFINITE, false);
+}
+
+bool
+PlatformTryWaitSemaphore(void *semaphore) {
+    return WaitForSingleObjectEx(semaphore, 0, false) == WAIT_OBJECT_0;
+}
+
+s64
+PlatformGetWallClock() {
+    LARGE_INTEGER time;
+    QueryPerformanceCounter(&time);
+    return time.QuadPart;
+}
+
+f32
+PlatformGetSecondsElapsed(s64 start, s64 end) {
+    return static_cast<f32>(end - start) / performance_frequency;
+}
+
+s64
+PlatformGetWallClockFrequency() {
+    return performance_frequency;
+}
+
+void
+PlatformSleep(f32 seconds) {
+    // WinMain sets the timer resolution to 1 ms
+    DWORD milliseconds = static_cast<DWORD>(seconds * 1000.0f);
+    if (milliseconds > 0) {
+        Sleep(milliseconds);
+    }
+}
+
+static void
+Win32RunRenderThread(void *data) {
+    Win32RenderThread *thread = static_cast<Win32RenderThread *>(data);
+    if (!wglMakeCurrent(thread->device_context, thread->gl_rendering_context)) {
+        PlatformShowErrorAndExit("OpenGL context error");
+    }
+
+    // WGL_EXT_swap_control
+    Win32SwapIntervalFunction *wglSwapIntervalEXT = reinterpret_cast<Win32SwapIntervalFunction *>(wglGetProcAddress("wglSwapIntervalEXT"));
+    if (wglSwapIntervalEXT) {
+        wglSwapIntervalEXT(SWAP_INTERVAL);
+    }
+
+    // SwapBuffers waits here instead of in the simulation
+    while (RenderCommandList *list = BeginReadRenderCommands(thread->queue)) {
+        ExecuteRenderCommands(&thread->backend, list);
+        SwapBuffers(thread->device_context);
+        EndReadRenderCommands(thread->queue);
+    }
+
+    wglMakeCurrent(0, 0);
+    PlatformSignalSemaphore(thread->stopped, 1);
+}
+
+
 s32
 WinMain(HINSTANCE instance, HINSTANCE, LPSTR, s32) {
     HWND window = Win32CreateWindow(instance);
@@ -175,26 +338,58 @@ WinMain(HINSTANCE instance, HINSTANCE, LPSTR, s32) {
         NOT_IMPLEMENTED;
     }
 
-    GameInit(WINDOW_WIDTH, WINDOW_HEIGHT);
+    LARGE_INTEGER pf;
+    QueryPerformanceFrequency(&pf);
+    performance_frequency = pf.QuadPart;
+    timeBeginPeriod(1);
+
+    OpenGLRenderer renderer;
+    RenderQueue render_queue;
+    InitRenderQueue(&render_queue);
+    Win32RenderThread render_thread;
+    render_thread.device_context = device_context;
+    render_thread.gl_rendering_context = gl_rendering_context;
+    render_thread.backend = InitOpenGLRenderer(&renderer, { WINDOW_WIDTH, WINDOW_HEIGHT });
+    render_thread.queue = &render_queue;
+    render_thread.stopped = PlatformCreateSemaphore(0);
+    wglMakeCurrent(0, 0);
+    PlatformStartThread(Win32RunRenderThread, &render_thread);
+
+    // The main thread also runs jobs, so it is not counted as a worker
+    InitJobSystem(PlatformGetProcessorCount() - 1);
+    GameInit(&game, WINDOW_WIDTH, WINDOW_HEIGHT);
+    RenderSystem render_system = {};
+    InitRenderSystem(&render_system, "sprites\\spritesheet.bmp");
     Input input = {};
     f32 delta_time = 0.016f;
+    FramePacer pacer;
+    InitFramePacer(&pacer, TARGET_FRAME_RATE, DEFAULT_FRAME_PACER_SPIN_SECONDS);
 
-    LARGE_INTEGER pf;
-    QueryPerformanceFrequency(&pf);
-    s64 performance_frequency = pf.QuadPart;
-    s64 frame_time_start = Win32GetWallClock();
+    s64 title_time = PlatformGetWallClock();
     while (is_window_open) {
         Win32ProcessMessages(&input);
-        GameUpdate(delta_time, input);
-        SwapBuffers(device_context);
+        GameUpdate(&game, delta_time, input);
+        UpdateRenderSystem(&game.world, &render_system, &render_queue);
+        delta_time = WaitForNextFrame(&pacer);
 
-        s64 frame_time_end = Win32GetWallClock();
-        s64 frame_time_diff = frame_time_end - frame_time_start;
-        delta_time = static_cast<f32>(frame_time_diff) / performance_frequency;
-        frame_time_start = frame_time_end;
+        // There is no console, so the times go in the title
+        if (PlatformGetSecondsElapsed(title_time, pacer.last_frame_start) >= 1.0f) {
+            RenderStats stats = render_system.stats;
+            char title[160];
+            snprintf(title, sizeof(title), "Pacman - pacing error %.2f ms - GPU: static layer %.2f ms, screen %.2f ms, frame %.2f ms",
+                     pacer.average_error_seconds * 1000.0f, stats.static_layer_seconds * 1000.0f,
+                     stats.screen_seconds * 1000.0f, stats.frame_seconds * 1000.0f);
+            SetWindowTextA(window, title);
+            title_time = pacer.last_frame_start;
+        }
     }
 
+    CloseRenderQueue(&render_queue);
+    PlatformWaitSemaphore(render_thread.stopped);
     wglDeleteContext(gl_rendering_context);
     ReleaseDC(window, device_context);
+    timeEndPeriod(1);
     return 0;
 }
+
+#endif // _WIN32
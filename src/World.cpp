@@ -1,32 +1,416 @@
 #include "World.hpp"
+#include "Platform.hpp"
 
 
+constexpr u32 NO_FREE_INDEX = 0xffffffff;
+
+
+static Entity
+MakeEntity(u32 index, u32 generation) {
+    return (generation << ENTITY_INDEX_BITS) | index;
+}
+
+static EntityRecord *
+GetRecordAtIndex(World *world, u32 index) {
+    EntityRecord *segment = world->record_segments[index >> RECORD_SEGMENT_BITS];
+    return &segment[index & (RECORD_SEGMENT_SIZE - 1)];
+}
+
+// Bumps the generation of a record that is not used anymore, and pushes
+// it onto the free list unless it is retired, see Entity
+static void
+ReleaseRecord(World *world, u32 index) {
+    EntityRecord *record = GetRecordAtIndex(world, index);
+    record->chunk = 0;
+    record->generation += 1;
+    if (record->generation < ENTITY_GENERATION_MASK) {
+        record->row = world->first_free_index;
+        world->first_free_index = index;
+    }
+}
+
+static void
+AllocateRecordSegment(World *world) {
+    ASSERT(world->num_record_segments < RECORD_SEGMENT_COUNT);
+    void *memory = PlatformAllocateMemory(RECORD_SEGMENT_SIZE * sizeof(EntityRecord));
+    world->record_segments[world->num_record_segments] = static_cast<EntityRecord *>(memory);
+    world->num_record_segments += 1;
+}
+
+static void
+ReleaseChunk(World *world, Chunk *chunk) {
+    chunk->next_free = world->free_chunks;
+    world->free_chunks = chunk;
+}
+
+static void
+AllocateChunkBlock(World *world) {
+    ChunkBlock *block = static_cast<ChunkBlock *>(PlatformAllocateMemory(sizeof(ChunkBlock)));
+    block->next = world->chunk_blocks;
+    world->chunk_blocks = block;
+    for (u32 i = 0; i < CHUNKS_PER_BLOCK; ++i) {
+        block->chunks[i].id = world->num_chunks + i;
+        ReleaseChunk(world, &block->chunks[i]);
+    }
+
+    world->num_chunks += CHUNKS_PER_BLOCK;
+}
+
+static Chunk *
+AcquireChunk(World *world) {
+    if (!world->free_chunks) {
+        AllocateChunkBlock(world);
+    }
+
+    Chunk *chunk = world->free_chunks;
+    world->free_chunks = chunk->next_free;
+    chunk->count = 0;
+    chunk->next_free = 0;
+    return chunk;
+}
+
+static void
+CopyRow(Chunk *dst, u32 dst_row, Chunk *src, u32 src_row) {
+    dst->entities[dst_row] = src->entities[src_row];
+    dst->translate_xs[dst_row] = src->translate_xs[src_row];
+    dst->translate_ys[dst_row] = src->translate_ys[src_row];
+    dst->scales[dst_row] = src->scales[src_row];
+    dst->sprites[dst_row] = src->sprites[src_row];
+    dst->animations[dst_row] = src->animations[src_row];
+    dst->motions[dst_row] = src->motions[src_row];
+}
+
+// Appends a row to the archetype of mask. The caller fills it.
+static void
+PushRow(World *world, u32 mask, Chunk **chunk, u32 *row) {
+    Archetype *archetype = &world->archetypes[mask];
+    if (!archetype->is_ordered) {
+        archetype->is_ordered = true;
+        archetype->order = world->num_ordered_archetypes;
+        world->archetype_order[world->num_ordered_archetypes] = mask;
+        world->num_ordered_archetypes += 1;
+    }
+
+    Chunk *last_chunk = (archetype->num_chunks > 0) ? archetype->chunks[archetype->num_chunks - 1] : 0;
+    if (!last_chunk || last_chunk->count == CHUNK_CAPACITY) {
+        if (archetype->num_chunks == archetype->chunk_capacity) {
+            // Only the array of pointers moves, the chunks stay where they are
+            u32 new_capacity = (archetype->chunk_capacity > 0) ? archetype->chunk_capacity * 2 : 16;
+            Chunk **new_chunks = static_cast<Chunk **>(PlatformAllocateMemory(new_capacity * sizeof(Chunk *)));
+            for (u32 i = 0; i < archetype->num_chunks; ++i) {
+                new_chunks[i] = archetype->chunks[i];
+            }
+
+            if (archetype->chunks) {
+                PlatformFreeMemory(archetype->chunks);
+            }
+
+            archetype->chunks = new_chunks;
+            archetype->chunk_capacity = new_capacity;
+        }
+
+        last_chunk = AcquireChunk(world);
+        last_chunk->mask = mask;
+        last_chunk->index = archetype->num_chunks;
+        archetype->chunks[archetype->num_chunks] = last_chunk;
+        archetype->num_chunks += 1;
+    }
+
+    *chunk = last_chunk;
+    *row = last_chunk->count;
+    last_chunk->count += 1;
+    MarkChunkChanged(last_chunk, ~0u, world->change_version);
+}
+
+// Fills the hole with the last row of the archetype,
+// so that only the last chunk is ever partly filled
+static void
+RemoveRow(World *world, Chunk *chunk, u32 row) {
+    Archetype *archetype = &world->archetypes[chunk->mask];
+    Chunk *last_chunk = archetype->chunks[archetype->num_chunks - 1];
+    u32 last_row = last_chunk->count - 1;
+    if (chunk != last_chunk || row != last_row) {
+        CopyRow(chunk, row, last_chunk, last_row);
+        EntityRecord *moved = GetRecordAtIndex(world, EntityIndex(chunk->entities[row]));
+        moved->chunk = chunk;
+        moved->row = row;
+        MarkChunkChanged(chunk, ~0u, world->change_version);
+    }
+
+    MarkChunkChanged(last_chunk, ~0u, world->change_version);
+    last_chunk->count -= 1;
+    if (last_chunk->count == 0) {
+        archetype->num_chunks -= 1;
+        ReleaseChunk(world, last_chunk);
+    }
+}
+
+// Every mask change goes through here
+static void
+MoveEntity(World *world, EntityRecord *record, u32 mask) {
+    ASSERT(!world->is_structure_locked);
+    Chunk *old_chunk = record->chunk;
+    u32 old_row = record->row;
+    if (old_chunk->mask == mask) {
+        return;
+    }
+
+    Chunk *new_chunk;
+    u32 new_row;
+    PushRow(world, mask, &new_chunk, &new_row);
+    CopyRow(new_chunk, new_row, old_chunk, old_row);
+    RemoveRow(world, old_chunk, old_row);
+    record->chunk = new_chunk;
+    record->row = new_row;
+}
+
+static EntityRecord *
+GetRecord(World *world, Entity entity) {
+    ASSERT(IsEntityAlive(world, entity));
+    return GetRecordAtIndex(world, EntityIndex(entity));
+}
+
+void
+InitWorld(World *world, u32 initial_capacity) {
+    ASSERT(initial_capacity <= MAX_ENTITIES);
+    *world = {};
+    world->first_free_index = NO_FREE_INDEX;
+
+    // A consumer that starts at version 0 sees everything as changed
+    world->change_version = 1;
+    while (world->num_record_segments * RECORD_SEGMENT_SIZE < initial_capacity) {
+        AllocateRecordSegment(world);
+    }
+
+    u32 num_chunks = (initial_capacity + CHUNK_CAPACITY - 1) / CHUNK_CAPACITY;
+    for (u32 i = 0; i < num_chunks; i += CHUNKS_PER_BLOCK) {
+        AllocateChunkBlock(world);
+    }
+}
+
+void
+ClearWorld(World *world) {
+    ASSERT(!world->is_structure_locked);
+
+    // The free list is built backwards, so the records are handed out
+    // again in the order of a new World
+    world->first_free_index = NO_FREE_INDEX;
+    for (u32 i = world->num_used_indices; i-- > 0;) {
+        EntityRecord *record = GetRecordAtIndex(world, i);
+        if (record->chunk) {
+            ReleaseRecord(world, i);
+        }
+        else if (record->generation < ENTITY_GENERATION_MASK) {
+            record->row = world->first_free_index;
+            world->first_free_index = i;
+        }
+    }
+
+    for (u32 order = 0; order < world->num_ordered_archetypes; ++order) {
+        Archetype *archetype = &world->archetypes[world->archetype_order[order]];
+        for (u32 i = 0; i < archetype->num_chunks; ++i) {
+            ReleaseChunk(world, archetype->chunks[i]);
+        }
+
+        archetype->num_chunks = 0;
+        archetype->is_ordered = false;
+    }
+
+    world->num_ordered_archetypes = 0;
+    world->change_version += 1;
+}
+
+void
+FreeWorld(World *world) {
+    for (u32 i = 0; i < world->num_record_segments; ++i) {
+        PlatformFreeMemory(world->record_segments[i]);
+    }
+
+    for (u32 i = 0; i < ARCHETYPE_COUNT; ++i) {
+        if (world->archetypes[i].chunks) {
+            PlatformFreeMemory(world->archetypes[i].chunks);
+        }
+    }
+
+    ChunkBlock *block = world->chunk_blocks;
+    while (block) {
+        ChunkBlock *next = block->next;
+        PlatformFreeMemory(block);
+        block = next;
+    }
+
+    *world = {};
+}
+
+u32
+EntityIndex(Entity entity) {
+    return entity & ENTITY_INDEX_MASK;
+}
+
+u32
+EntityGeneration(Entity entity) {
+    return entity >> ENTITY_INDEX_BITS;
+}
+
 Entity
 CreateEntity(World *world) {
-    for (u32 i = 0; i < MAX_ENTITIES; ++i) {
-        if (world->entity_masks[i] == MASK_NONE) {
-            return { i };
+    ASSERT(!world->is_structure_locked);
+    u32 index;
+    if (world->first_free_index != NO_FREE_INDEX) {
+        index = world->first_free_index;
+        world->first_free_index = GetRecordAtIndex(world, index)->row;
+    }
+    else if (world->num_used_indices < MAX_ENTITIES) {
+        index = world->num_used_indices;
+        if (index == world->num_record_segments * RECORD_SEGMENT_SIZE) {
+            AllocateRecordSegment(world);
         }
+
+        world->num_used_indices += 1;
+    }
+    else {
+        NOT_IMPLEMENTED;
+        return INVALID_ENTITY;
     }
 
-    NOT_IMPLEMENTED;
-    return { MAX_ENTITIES };
+    EntityRecord *record = GetRecordAtIndex(world, index);
+    Entity entity = MakeEntity(index, record->generation);
+    PushRow(world, MASK_NONE, &record->chunk, &record->row);
+
+    Chunk *chunk = record->chunk;
+    u32 row = record->row;
+    chunk->entities[row] = entity;
+    chunk->translate_xs[row] = 0.0f;
+    chunk->translate_ys[row] = 0.0f;
+    chunk->scales[row] = {};
+    chunk->sprites[row] = {};
+    chunk->animations[row] = {};
+    chunk->motions[row] = {};
+    return entity;
 }
 
 Entity
 CreateGhost(World *world, Transform transform, Sprite sprite, u8 sprite_id) {
     Entity ghost = CreateEntity(world);
-    world->entity_masks[ghost] = MASK_TRANSFORM | MASK_SPRITE | MASK_ANIMATION | MASK_MOTION;
-    world->transforms[ghost] = transform;
-    world->sprites[ghost] = sprite;
+    SetMask(world, ghost, MASK_TRANSFORM | MASK_SPRITE | MASK_ANIMATION | MASK_MOTION);
+    SetTransform(world, ghost, transform);
+    *GetSprite(world, ghost) = sprite;
 
-    Animation *animation = &world->animations[ghost];
+    Animation *animation = GetAnimation(world, ghost);
     animation->base_sprite_id = sprite_id;
     animation->num_frames = 2;
     animation->seconds_between_frames = 0.15f;
     animation->is_looped = true;
 
-    Motion *motion = &world->motions[ghost];
+    Motion *motion = GetMotion(world, ghost);
     motion->speed = 150;
     return ghost;
 }
+
+void
+DestroyEntity(World *world, Entity entity) {
+    ASSERT(!world->is_structure_locked);
+    EntityRecord *record = GetRecord(world, entity);
+    RemoveRow(world, record->chunk, record->row);
+    ReleaseRecord(world, EntityIndex(entity));
+}
+
+bool
+IsEntityAlive(World *world, Entity entity) {
+    u32 index = EntityIndex(entity);
+    if (index >= world->num_used_indices) {
+        return false;
+    }
+
+    EntityRecord *record = GetRecordAtIndex(world, index);
+    return record->chunk && record->generation == EntityGeneration(entity);
+}
+
+u32
+GetMask(World *world, Entity entity) {
+    return GetRecord(world, entity)->chunk->mask;
+}
+
+void
+SetMask(World *world, Entity entity, u32 mask) {
+    MoveEntity(world, GetRecord(world, entity), mask);
+}
+
+void
+AddComponents(World *world, Entity entity, u32 mask) {
+    EntityRecord *record = GetRecord(world, entity);
+    MoveEntity(world, record, record->chunk->mask | mask);
+}
+
+void
+RemoveComponents(World *world, Entity entity, u32 mask) {
+    EntityRecord *record = GetRecord(world, entity);
+    MoveEntity(world, record, record->chunk->mask & ~mask);
+}
+
+void
+MarkChanged(World *world, Entity entity, u32 mask) {
+    MarkChunkChanged(GetRecord(world, entity)->chunk, mask, world->change_version);
+}
+
+Chunk *
+NextChunk(World *world, u32 mask, Chunk *chunk) {
+    u32 order = 0;
+    if (chunk) {
+        Archetype *archetype = &world->archetypes[chunk->mask];
+        if (chunk->index + 1 < archetype->num_chunks) {
+            return archetype->chunks[chunk->index + 1];
+        }
+
+        order = archetype->order + 1;
+    }
+
+    for (; order < world->num_ordered_archetypes; ++order) {
+        u32 archetype_mask = world->archetype_order[order];
+        Archetype *archetype = &world->archetypes[archetype_mask];
+        if ((archetype_mask & mask) == mask && archetype->num_chunks > 0) {
+            return archetype->chunks[0];
+        }
+    }
+
+    return 0;
+}
+
+Transform
+GetTransform(World *world, Entity entity) {
+    EntityRecord *record = GetRecord(world, entity);
+    Chunk *chunk = record->chunk;
+    Transform transform;
+    transform.scale = chunk->scales[record->row];
+    transform.translate.x = chunk->translate_xs[record->row];
+    transform.translate.y = chunk->translate_ys[record->row];
+    return transform;
+}
+
+void
+SetTransform(World *world, Entity entity, Transform transform) {
+    EntityRecord *record = GetRecord(world, entity);
+    Chunk *chunk = record->chunk;
+    chunk->scales[record->row] = transform.scale;
+    chunk->translate_xs[record->row] = transform.translate.x;
+    chunk->translate_ys[record->row] = transform.translate.y;
+    MarkChunkChanged(chunk, MASK_TRANSFORM, world->change_version);
+}
+
+Sprite *
+GetSprite(World *world, Entity entity) {
+    EntityRecord *record = GetRecord(world, entity);
+    return &record->chunk->sprites[record->row];
+}
+
+Animation *
+GetAnimation(World *world, Entity entity) {
+    EntityRecord *record = GetRecord(world, entity);
+    return &record->chunk->animations[record->row];
+}
+
+Motion *
+GetMotion(World *world, Entity entity) {
+    EntityRecord *record = GetRecord(world, entity);
+    return &record->chunk->motions[record->row];
+}
@@ -2,12 +2,107 @@
 #define PACMAN_WORLD_HPP
 #include "Common.hpp"
 #include "Components.hpp"
+#include "Jobs.hpp"
 
 
-constexpr u32 MAX_ENTITIES = 256;
-
+// An Entity is a handle, not a plain index. The low bits are the index
+// of its record in the World and the high bits are the generation of
+// that record. The generation is bumped every time the record is released,
+// so a handle to a destroyed entity never matches the entity that reuses
+// its record. A record whose generation reaches ENTITY_GENERATION_MASK is
+// retired instead of wrapping around, and never handed out again.
 typedef u32 Entity;
 
+constexpr u32 ENTITY_INDEX_BITS = 20;
+constexpr u32 ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1;
+constexpr u32 ENTITY_GENERATION_MASK = (1u << (32 - ENTITY_INDEX_BITS)) - 1;
+
+// The World grows on demand, so this is only the limit of what fits in
+// a handle. The last index is never handed out, so INVALID_ENTITY is
+// never alive.
+constexpr u32 MAX_ENTITIES = ENTITY_INDEX_MASK;
+constexpr Entity INVALID_ENTITY = 0xffffffff;
+
+// Records are allocated in segments that never move, so
+// growing the World does not invalidate a record pointer
+constexpr u32 RECORD_SEGMENT_BITS = 12;
+constexpr u32 RECORD_SEGMENT_SIZE = 1u << RECORD_SEGMENT_BITS;
+constexpr u32 RECORD_SEGMENT_COUNT = (1u << ENTITY_INDEX_BITS) / RECORD_SEGMENT_SIZE;
+
+// One archetype for every possible mask
+constexpr u32 ARCHETYPE_COUNT = 1 << COMPONENT_COUNT;
+
+// A chunk is sized to stay in L1/L2 while a system walks it
+constexpr u32 CHUNK_SIZE = 16 * 1024;
+constexpr u32 CHUNK_HEADER_SIZE = 64;
+constexpr u32 CHUNK_ROW_SIZE = sizeof(Entity) + sizeof(Transform) + sizeof(Sprite) + sizeof(Animation) + sizeof(Motion);
+
+// A multiple of 8, so that the movement system can process 8 rows with
+// one AVX2 instruction. The columns it reads are 32 byte aligned.
+constexpr u32 SIMD_WIDTH = 8;
+constexpr u32 CHUNK_CAPACITY = ((CHUNK_SIZE - CHUNK_HEADER_SIZE) / CHUNK_ROW_SIZE) & ~(SIMD_WIDTH - 1);
+
+// Chunks are allocated this many at a time
+constexpr u32 CHUNKS_PER_BLOCK = 16;
+
+// Enough for the stock maze. GameInit asks for this much up front.
+constexpr u32 DEFAULT_ENTITY_CAPACITY = 256;
+
+
+// All entities in a chunk have the same mask, so a system that walks a
+// chunk reads contiguous arrays without testing each entity. Every chunk
+// has a column for every component, even the ones that are not in its
+// mask. That way an entity keeps the data of a component while the bit is
+// cleared, e.g., Pacman keeps its Animation while standing still.
+//
+// versions[i] is the World::change_version of the last write to column i.
+// Adding or removing a row counts as a write to every column.
+//
+// The Transform component is split into three columns, so that the
+// positions can be updated with SIMD instructions. Use GetTransform and
+// SetTransform for a single entity.
+struct Chunk {
+    u32 mask;
+    u32 count;
+    u32 index; // Position in Archetype::chunks
+    u32 id; // Unique in its World, so systems can keep data per chunk
+    u32 versions[COMPONENT_COUNT];
+    Chunk *next_free;
+
+    alignas(CHUNK_HEADER_SIZE) Entity entities[CHUNK_CAPACITY];
+    alignas(32) f32 translate_xs[CHUNK_CAPACITY];
+    alignas(32) f32 translate_ys[CHUNK_CAPACITY];
+    Vector2 scales[CHUNK_CAPACITY];
+    Sprite sprites[CHUNK_CAPACITY];
+    Animation animations[CHUNK_CAPACITY];
+    alignas(32) Motion motions[CHUNK_CAPACITY]; // The columns before it are bytes
+};
+
+static_assert(sizeof(Chunk) <= CHUNK_SIZE, "Chunk does not fit in CHUNK_SIZE");
+
+struct ChunkBlock {
+    Chunk chunks[CHUNKS_PER_BLOCK];
+    ChunkBlock *next;
+};
+
+// All chunks of an archetype are full except the last one.
+// Removing an entity moves the last entity of the archetype into the hole.
+// The chunks are kept in an array so that they can be split between jobs.
+struct Archetype {
+    Chunk **chunks;
+    u32 num_chunks;
+    u32 chunk_capacity;
+    u32 order; // Position in World::archetype_order
+    bool is_ordered;
+};
+
+// Where the components of an entity are stored. chunk is 0 when
+// the record is not in use, and row is then the next free record.
+struct EntityRecord {
+    u32 generation;
+    u32 row;
+    Chunk *chunk;
+};
 
 struct World {
     // We store these values here instead of in the
@@ -17,18 +112,282 @@ struct World {
     Vector2Int window_size;
     f32 delta_time;
 
-    u32 entity_masks[MAX_ENTITIES];
-    Transform transforms[MAX_ENTITIES];
-    Sprite sprites[MAX_ENTITIES];
-    Animation animations[MAX_ENTITIES];
-    Motion motions[MAX_ENTITIES];
+    // Released records are pushed onto a free list and reused first.
+    // Records in [0, num_used_indices) have been handed out at least once,
+    // so a new record is only taken from the end when the list is empty.
+    EntityRecord *record_segments[RECORD_SEGMENT_COUNT];
+    u32 num_record_segments;
+    u32 first_free_index;
+    u32 num_used_indices;
+
+    // Archetypes are indexed by mask. archetype_order lists the masks
+    // in the order they were first used, which is the order systems walk
+    // them in. The render system relies on this to draw the maze first.
+    Archetype archetypes[ARCHETYPE_COUNT];
+    u32 archetype_order[ARCHETYPE_COUNT];
+    u32 num_ordered_archetypes;
+
+    ChunkBlock *chunk_blocks;
+    Chunk *free_chunks;
+    u32 num_chunks; // Allocated so far, the ids are [0, num_chunks)
+
+    // Set while the scheduler runs the systems, which have to
+    // record structural changes in a CommandBuffer instead
+    bool is_structure_locked;
+
+    // The scheduler runs the systems, and ParallelForEachChunk the chunks,
+    // on the calling thread, in order, and neither adds jobs. For when
+    // there are enough Worlds to keep the threads busy.
+    bool is_single_threaded;
+
+    // Stamped into Chunk::versions on every write. A consumer remembers the
+    // version it last ran at and skips the chunks that are not newer.
+    // The scheduler bumps it every frame and before playing back commands.
+    u32 change_version;
 };
 
 
+// Reserves room for initial_capacity entities. The World grows past it
+// on demand, in segments, so pointers to records and chunks stay valid.
+void
+InitWorld(World *world, u32 initial_capacity);
+
+// Destroys every entity, but keeps the memory for the next ones.
+// change_version keeps counting, so consumers see the new chunks as changed.
+void
+ClearWorld(World *world);
+
+void
+FreeWorld(World *world);
+
+u32
+EntityIndex(Entity entity);
+
+u32
+EntityGeneration(Entity entity);
+
 Entity
 CreateEntity(World *world);
 
 Entity
 CreateGhost(World *world, Transform transform, Sprite sprite, u8 sprite_id);
 
+void
+DestroyEntity(World *world, Entity entity);
+
+bool
+IsEntityAlive(World *world, Entity entity);
+
+// The functions below take a handle and ASSERT that it is still alive,
+// which catches stale handles in debug builds. Changing the mask moves
+// the entity to another chunk, and the component pointers of the entity
+// and of the entity that fills its old row are no longer valid.
+u32
+GetMask(World *world, Entity entity);
+
+void
+SetMask(World *world, Entity entity, u32 mask);
+
+void
+AddComponents(World *world, Entity entity, u32 mask);
+
+void
+RemoveComponents(World *world, Entity entity, u32 mask);
+
+// Call after writing through one of the Get functions below. Queries
+// mark the components they do not take as const themselves.
+void
+MarkChanged(World *world, Entity entity, u32 mask);
+
+// Walks the chunks whose mask has all the bits of mask set:
+//
+//     for (Chunk *chunk = NextChunk(world, MASK, 0); chunk; chunk = NextChunk(world, MASK, chunk))
+//
+// Chunks are returned in archetype order. Changing masks while walking
+// moves entities between chunks, so it might skip or revisit entities.
+Chunk *
+NextChunk(World *world, u32 mask, Chunk *chunk);
+
+Transform
+GetTransform(World *world, Entity entity);
+
+void
+SetTransform(World *world, Entity entity, Transform transform);
+
+Sprite *
+GetSprite(World *world, Entity entity);
+
+Animation *
+GetAnimation(World *world, Entity entity);
+
+Motion *
+GetMotion(World *world, Entity entity);
+
+inline void
+MarkChunkChanged(Chunk *chunk, u32 mask, u32 version) {
+    for (u32 i = 0; i < COMPONENT_COUNT; ++i) {
+        if (mask & (1 << i)) {
+            chunk->versions[i] = version;
+        }
+    }
+}
+
+// True if any of the columns in mask was written after version
+inline bool
+HasChunkChanged(Chunk *chunk, u32 mask, u32 version) {
+    for (u32 i = 0; i < COMPONENT_COUNT; ++i) {
+        if ((mask & (1 << i)) && chunk->versions[i] > version) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Maps a component type to its bit in the mask and its column in a Chunk.
+// Transform is stored in several columns, so it cannot be used in a query.
+// Use ParallelForEachChunk, or NextChunk, and the columns instead.
+template <typename T>
+struct ComponentTraits;
+
+template <>
+struct ComponentTraits<Sprite> {
+    static constexpr u32 MASK = MASK_SPRITE;
+    static Sprite *Column(Chunk *chunk) { return chunk->sprites; }
+};
+
+template <>
+struct ComponentTraits<Animation> {
+    static constexpr u32 MASK = MASK_ANIMATION;
+    static Animation *Column(Chunk *chunk) { return chunk->animations; }
+};
+
+template <>
+struct ComponentTraits<Motion> {
+    static constexpr u32 MASK = MASK_MOTION;
+    static Motion *Column(Chunk *chunk) { return chunk->motions; }
+};
+
+// A query only reads the components it takes as const
+template <typename T>
+struct ComponentTraits<const T> {
+    static constexpr u32 MASK = ComponentTraits<T>::MASK;
+    static const T *Column(Chunk *chunk) { return ComponentTraits<T>::Column(chunk); }
+};
+
+template <typename... Ts>
+struct QueryMask;
+
+template <>
+struct QueryMask<> {
+    static constexpr u32 VALUE = MASK_NONE;
+};
+
+template <typename T, typename... Ts>
+struct QueryMask<T, Ts...> {
+    static constexpr u32 VALUE = ComponentTraits<T>::MASK | QueryMask<Ts...>::VALUE;
+};
+
+// Calls function(T1 &, T2 &, ...) for every entity that has all of the
+// components. The mask is computed at compile time and every instance
+// gets its own loop, so the compiler can inline the function into it.
+// Nothing is marked as changed, since most visits do not write, so a
+// function that does has to go through ParallelForEachChunk, or
+// MarkChanged, to mark what it wrote.
+//
+//     ForEach<Transform, const Motion>(world, [](Transform &transform, const Motion &motion) { ... });
+//
+// The function must not change masks, see NextChunk.
+template <typename... Ts, typename Function>
+void
+ForEach(World *world, Function function) {
+    constexpr u32 MASK = QueryMask<Ts...>::VALUE;
+    for (Chunk *chunk = NextChunk(world, MASK, 0); chunk; chunk = NextChunk(world, MASK, chunk)) {
+        u32 count = chunk->count;
+        for (u32 row = 0; row < count; ++row) {
+            function(ComponentTraits<Ts>::Column(chunk)[row]...);
+        }
+    }
+}
+
+// The matching archetypes of a ParallelForEachChunk. The chunks of all of
+// them are numbered one after the other, and first_chunks[i] is the number
+// of the first chunk of archetype i.
+template <typename Function>
+struct ChunkQuery {
+    Function *function;
+    u32 write_mask;
+    u32 change_version;
+    Chunk **chunks[ARCHETYPE_COUNT];
+    u32 first_chunks[ARCHETYPE_COUNT + 1];
+    u32 num_archetypes;
+};
+
+template <typename Function>
+void
+RunChunkQuery(void *data, u32 begin, u32 end) {
+    ChunkQuery<Function> *query = static_cast<ChunkQuery<Function> *>(data);
+    u32 archetype = 0;
+    for (u32 i = begin; i < end; ++i) {
+        while (i >= query->first_chunks[archetype + 1]) {
+            archetype += 1;
+        }
+
+        Chunk *chunk = query->chunks[archetype][i - query->first_chunks[archetype]];
+        MarkChunkChanged(chunk, query->write_mask, query->change_version);
+        (*query->function)(chunk);
+    }
+}
+
+// Calls function(Chunk *) for every chunk whose mask has all the bits of
+// mask set. The chunks are split between all threads with ParallelFor,
+// grain chunks at a time, unless the World is_single_threaded. The
+// columns in write_mask are marked as changed in every chunk, e.g., for a
+// column that the function always writes. Columns it only writes
+// sometimes it marks itself, with MarkChunkChanged. The order in which
+// chunks are visited is not defined, so the function must only touch the
+// chunk it is given.
+template <typename Function>
+void
+ParallelForEachChunk(World *world, u32 mask, u32 write_mask, u32 grain, Function function) {
+    ChunkQuery<Function> query;
+    query.function = &function;
+    query.write_mask = write_mask;
+    query.change_version = world->change_version;
+    query.num_archetypes = 0;
+    query.first_chunks[0] = 0;
+    for (u32 order = 0; order < world->num_ordered_archetypes; ++order) {
+        u32 archetype_mask = world->archetype_order[order];
+        Archetype *archetype = &world->archetypes[archetype_mask];
+        if ((archetype_mask & mask) == mask && archetype->num_chunks > 0) {
+            u32 i = query.num_archetypes;
+            query.chunks[i] = archetype->chunks;
+            query.first_chunks[i + 1] = query.first_chunks[i] + archetype->num_chunks;
+            query.num_archetypes += 1;
+        }
+    }
+
+    u32 num_chunks = query.first_chunks[query.num_archetypes];
+    if (world->is_single_threaded) {
+        RunChunkQuery<Function>(&query, 0, num_chunks);
+    }
+    else {
+        ParallelFor(num_chunks, grain, RunChunkQuery<Function>, &query);
+    }
+}
+
+// Same as ForEach, but the chunks are split between all threads,
+// see ParallelForEachChunk. Nothing is marked as changed either.
+template <typename... Ts, typename Function>
+void
+ParallelForEach(World *world, u32 grain, Function function) {
+    ParallelForEachChunk(world, QueryMask<Ts...>::VALUE, MASK_NONE, grain, [&](Chunk *chunk) {
+        u32 count = chunk->count;
+        for (u32 row = 0; row < count; ++row) {
+            function(ComponentTraits<Ts>::Column(chunk)[row]...);
+        }
+    });
+}
+
 #endif // PACMAN_WORLD_HPP